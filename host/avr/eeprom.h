@@ -0,0 +1,39 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+/** \file host/avr/eeprom.h
+ * \author Alexey A. Shabelnikov
+ * EEPROM of simulated ATmega644 (host build), see avrsim.c
+ */
+
+#ifndef _HOST_AVR_EEPROM_H_
+#define _HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+
+/**Contents of EEPROM */
+extern uint8_t sim_eeprom[E2END + 1];
+
+#define __EEGET(val, addr) ((val) = sim_eeprom[(addr)])
+#define __EEPUT(addr, val) (sim_eeprom[(addr)] = (val))
+
+#endif //_HOST_AVR_EEPROM_H_
@@ -0,0 +1,39 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+/** \file host/avr/interrupt.h
+ * \author Alexey A. Shabelnikov
+ * Interrupts of simulated ATmega644 (host build). Handlers are ordinary functions which are
+ * called by the simulator (see avrsim.c), global interrupt flag is the I bit of SREG.
+ */
+
+#ifndef _HOST_AVR_INTERRUPT_H_
+#define _HOST_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+/**Defines interrupt handler. Name of the function is the name of vector */
+#define ISR(vector) void vector(void); void vector(void)
+
+#define sei() (SREG|= _BV(SREG_I))   //!< enable interrupts globally
+#define cli() (SREG&= ~_BV(SREG_I))  //!< disable interrupts globally
+
+#endif //_HOST_AVR_INTERRUPT_H_
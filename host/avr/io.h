@@ -0,0 +1,282 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+/** \file host/avr/io.h
+ * \author Alexey A. Shabelnikov
+ * Simulated register file of ATmega644, used instead of <avr/io.h> when firmware's sources
+ * are compiled for the host (PC) by the "host" target of Makefile_gcc. Registers are ordinary
+ * variables (see avrsim.c), bit numbers are the same as in the real device.
+ */
+
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#define FLASHEND  0xFFFF           //!< last address of FLASH
+#define RAMEND    0x10FF           //!< last address of RAM
+#define E2END     0x07FF           //!< last address of EEPROM
+
+//Status register and general purpose I/O registers
+extern volatile uint8_t SREG;
+#define SREG_I    7
+extern volatile uint8_t GPIOR0;
+extern volatile uint8_t MCUSR;
+#define WDRF      3
+
+//I/O ports
+extern volatile uint8_t PORTA, DDRA, PINA;
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t PORTC, DDRC, PINC;
+extern volatile uint8_t PORTD, DDRD, PIND;
+
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PC7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define DDA0 0
+#define DDA1 1
+#define DDA2 2
+#define DDA3 3
+#define DDA4 4
+#define DDA5 5
+#define DDA6 6
+#define DDA7 7
+#define DDB0 0
+#define DDB1 1
+#define DDB2 2
+#define DDB3 3
+#define DDB4 4
+#define DDB5 5
+#define DDB6 6
+#define DDB7 7
+#define DDC0 0
+#define DDC1 1
+#define DDC2 2
+#define DDC3 3
+#define DDC4 4
+#define DDC5 5
+#define DDC6 6
+#define DDC7 7
+#define DDD0 0
+#define DDD1 1
+#define DDD2 2
+#define DDD3 3
+#define DDD4 4
+#define DDD5 5
+#define DDD6 6
+#define DDD7 7
+
+#define PINA0 0
+#define PINA1 1
+#define PINA2 2
+#define PINA3 3
+#define PINA4 4
+#define PINA5 5
+#define PINA6 6
+#define PINA7 7
+#define PINB0 0
+#define PINB1 1
+#define PINB2 2
+#define PINB3 3
+#define PINB4 4
+#define PINB5 5
+#define PINB6 6
+#define PINB7 7
+#define PINC0 0
+#define PINC1 1
+#define PINC2 2
+#define PINC3 3
+#define PINC4 4
+#define PINC5 5
+#define PINC6 6
+#define PINC7 7
+#define PIND0 0
+#define PIND1 1
+#define PIND2 2
+#define PIND3 3
+#define PIND4 4
+#define PIND5 5
+#define PIND6 6
+#define PIND7 7
+
+/**Access to the interrupt flag register of timer (TIFRx). Flag is cleared by writing one to it, so
+ * access goes through the simulator, which applies previous write before returning the register
+ * \param n Number of timer (0, 1, 2)
+ * \return pointer to the register
+ */
+volatile uint8_t* sim_tifr(uint8_t n);
+
+//Timer/Counter 0
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+#define TIFR0     (*sim_tifr(0))
+#define CS00      0
+#define CS01      1
+#define CS02      2
+#define TOIE0     0
+#define OCIE0A    1
+#define OCIE0B    2
+#define TOV0      0
+#define OCF0A     1
+#define OCF0B     2
+
+//Timer/Counter 1
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+#define TIFR1     (*sim_tifr(1))
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+#define CS10      0
+#define CS11      1
+#define CS12      2
+#define WGM12     3
+#define WGM13     4
+#define ICES1     6
+#define ICNC1     7
+#define TOIE1     0
+#define OCIE1A    1
+#define OCIE1B    2
+#define ICIE1     5
+#define TOV1      0
+#define OCF1A     1
+#define OCF1B     2
+#define ICF1      5
+
+//Timer/Counter 2
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+#define TIFR2     (*sim_tifr(2))
+#define CS20      0
+#define CS21      1
+#define CS22      2
+#define TOIE2     0
+#define OCIE2A    1
+#define OCIE2B    2
+#define TOV2      0
+#define OCF2A     1
+#define OCF2B     2
+
+//External interrupts
+extern volatile uint8_t EICRA, EIMSK, EIFR;
+#define ISC00     0
+#define ISC01     1
+#define ISC10     2
+#define ISC11     3
+#define ISC20     4
+#define ISC21     5
+#define INT0      0
+#define INT1      1
+#define INT2      2
+
+//ADC and analog comparator
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, ACSR;
+extern volatile uint16_t ADC;
+#define REFS0     6
+#define REFS1     7
+#define ADLAR     5
+#define ADPS0     0
+#define ADPS1     1
+#define ADPS2     2
+#define ADIE      3
+#define ADIF      4
+#define ADATE     5
+#define ADSC      6
+#define ADEN      7
+#define ACD       7
+
+//SPI
+extern volatile uint8_t SPCR, SPSR, SPDR;
+#define SPR0      0
+#define SPR1      1
+#define CPHA      2
+#define CPOL      3
+#define MSTR      4
+#define DORD      5
+#define SPE       6
+#define SPIE      7
+#define SPI2X     0
+#define SPIF      7
+
+//TWI (used only as a general purpose register)
+extern volatile uint8_t TWBR, TWSR;
+
+//USART0
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0L, UBRR0H, UDR0;
+#define U2X0      1
+#define UDRE0     5
+#define TXC0      6
+#define RXC0      7
+#define TXEN0     3
+#define RXEN0     4
+#define UDRIE0    5
+#define TXCIE0    6
+#define RXCIE0    7
+#define UCSZ00    1
+#define UCSZ01    2
+
+//EEPROM
+extern volatile uint8_t EECR, EEDR;
+extern volatile uint16_t EEAR;
+#define EERE      0
+#define EEPE      1
+#define EEMPE     2
+#define EERIE     3
+
+//Watchdog
+extern volatile uint8_t WDTCSR;
+#define WDP0      0
+#define WDP1      1
+#define WDP2      2
+#define WDE       3
+#define WDCE      4
+#define WDP3      5
+#define WDIE      6
+#define WDIF      7
+
+#define _BV(bit) (1 << (bit))
+
+#endif //_HOST_AVR_IO_H_
@@ -0,0 +1,294 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+/** \file avrsim.c
+ * \author Alexey A. Shabelnikov
+ * Implementation of the simulator of ATmega644's timers, ADC and interrupts (host build).
+ * (Реализация симулятора таймеров, АЦП и прерываний ATmega644 для сборки прошивки на PC).
+ *
+ * Limitations:
+ * - Handlers of interrupts are executed in zero time, so their latency is not simulated.
+ * - Flag of timer's interrupt is cleared by writing one to it (see sim_tifr()), but writing one to
+ *   already set flag can not be distinguished from absence of writing. Thus flags are set only if
+ *   corresponding interrupts are enabled, so firmware almost never has to clear stale flags.
+ * - Only normal mode of timers is supported, compare outputs are not simulated.
+ */
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "avrsim.h"
+
+//Simulated registers
+volatile uint8_t SREG, GPIOR0, MCUSR;
+volatile uint8_t PORTA, DDRA, PINA;
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC, PINC;
+volatile uint8_t PORTD, DDRD, PIND;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+volatile uint8_t EICRA, EIMSK, EIFR;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB, ACSR;
+volatile uint16_t ADC;
+volatile uint8_t SPCR, SPSR, SPDR;
+volatile uint8_t TWBR, TWSR;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0L, UBRR0H, UDR0;
+volatile uint8_t EECR, EEDR;
+volatile uint16_t EEAR;
+volatile uint8_t WDTCSR;
+
+uint8_t sim_eeprom[E2END + 1];
+
+uint64_t sim_steps;
+uint16_t sim_adc_values[8];
+
+//Handlers of interrupts. Weak references are used because set of handlers depends on options of firmware
+extern void TIMER2_COMPA_vect(void) __attribute__((weak));
+extern void TIMER2_COMPB_vect(void) __attribute__((weak));
+extern void TIMER2_OVF_vect(void) __attribute__((weak));
+extern void TIMER1_CAPT_vect(void) __attribute__((weak));
+extern void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern void TIMER1_COMPB_vect(void) __attribute__((weak));
+extern void TIMER1_OVF_vect(void) __attribute__((weak));
+extern void TIMER0_COMPA_vect(void) __attribute__((weak));
+extern void TIMER0_COMPB_vect(void) __attribute__((weak));
+extern void TIMER0_OVF_vect(void) __attribute__((weak));
+extern void ADC_vect(void) __attribute__((weak));
+
+/**Describes interrupt source */
+typedef struct
+{
+ void (*handler)(void);                 //!< handler
+ volatile uint8_t* msk;                 //!< register containing enable bit
+ uint8_t* flg;                          //!< flags register (kept by simulator)
+ uint8_t bit;                           //!< number of enable bit and flag bit
+}sim_vect_t;
+
+/**State of the simulator */
+static struct
+{
+ uint8_t tifr[3];                       //!< flags of timers' interrupts
+ uint8_t tifr_reg[3];                   //!< TIFRx registers as they are seen by firmware
+ uint8_t tifr_ld[3];                    //!< values loaded into tifr_reg, used to detect writes
+ uint8_t adif;                          //!< flag of ADC interrupt (stored as bit 0)
+ uint32_t adc_cycles;                   //!< number of CPU cycles remaining to the end of conversion, 0 - ADC is idle
+ uint32_t cycles;                       //!< counts CPU cycles, used for prescaling
+}sim;
+
+/**Interrupt sources in order of priority (order of vectors of ATmega644) */
+static const sim_vect_t sim_vectors[] =
+{
+ {TIMER2_COMPA_vect, &TIMSK2, &sim.tifr[2], OCF2A},
+ {TIMER2_COMPB_vect, &TIMSK2, &sim.tifr[2], OCF2B},
+ {TIMER2_OVF_vect,   &TIMSK2, &sim.tifr[2], TOV2},
+ {TIMER1_CAPT_vect,  &TIMSK1, &sim.tifr[1], ICF1},
+ {TIMER1_COMPA_vect, &TIMSK1, &sim.tifr[1], OCF1A},
+ {TIMER1_COMPB_vect, &TIMSK1, &sim.tifr[1], OCF1B},
+ {TIMER1_OVF_vect,   &TIMSK1, &sim.tifr[1], TOV1},
+ {TIMER0_COMPA_vect, &TIMSK0, &sim.tifr[0], OCF0A},
+ {TIMER0_COMPB_vect, &TIMSK0, &sim.tifr[0], OCF0B},
+ {TIMER0_OVF_vect,   &TIMSK0, &sim.tifr[0], TOV0},
+ {ADC_vect,          &ADCSRA, &sim.adif,  ADIE},
+};
+
+#define SIM_VECTORS_NUM (sizeof(sim_vectors) / sizeof(sim_vectors[0]))
+
+/**Prescalers of timers 0 and 1 selected by CSx2:0 bits (0 - timer is stopped or clocked externally) */
+static const uint16_t tmr01_div[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+/**Prescalers of timer 2 selected by CS22:0 bits */
+static const uint16_t tmr2_div[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+
+/**Applies value written by firmware into TIFRx register (if any) and reloads register
+ * \param n Number of timer
+ */
+static void tifr_flush(uint8_t n)
+{
+ if (sim.tifr_reg[n] != sim.tifr_ld[n])
+  sim.tifr[n]&= ~sim.tifr_reg[n];        //flags are cleared by writing ones
+ sim.tifr_reg[n] = sim.tifr_ld[n] = sim.tifr[n];
+}
+
+volatile uint8_t* sim_tifr(uint8_t n)
+{
+ tifr_flush(n);
+ return &sim.tifr_reg[n];
+}
+
+/**Updates registers of flags visible to firmware */
+static void sync_flags(void)
+{
+ uint8_t n;
+ for(n = 0; n < 3; ++n)
+ {
+  sim.tifr_reg[n] = sim.tifr_ld[n] = sim.tifr[n];
+ }
+ ADCSRA = (ADCSRA & ~_BV(ADIF)) | (sim.adif ? _BV(ADIF) : 0);
+}
+
+/**Checks whether timer with given prescaler is clocked on the current step
+ * (prescalers less than SIM_STEP_CYCLES are clocked once per step) */
+static uint8_t tmr_clocked(uint16_t div)
+{
+ if (!div)
+  return 0;
+ return (div <= SIM_STEP_CYCLES) || (0 == (sim.cycles % div));
+}
+
+/**Sets flag of interrupt if it is enabled (see limitations at the top of this file)*/
+static void set_flag(uint8_t* flg, volatile uint8_t msk, uint8_t bit)
+{
+ if (msk & _BV(bit))
+  *flg|= _BV(bit);
+}
+
+/**Applies writes made by firmware into all TIFRx registers */
+static void flush_all(void)
+{
+ tifr_flush(0);
+ tifr_flush(1);
+ tifr_flush(2);
+}
+
+static void step_timers(void)
+{
+ if (tmr_clocked(tmr01_div[TCCR0B & 7]))
+ {
+  if (0==++TCNT0)
+   set_flag(&sim.tifr[0], TIMSK0, TOV0);
+  if (TCNT0 == OCR0A)
+   set_flag(&sim.tifr[0], TIMSK0, OCF0A);
+  if (TCNT0 == OCR0B)
+   set_flag(&sim.tifr[0], TIMSK0, OCF0B);
+ }
+
+ if (tmr_clocked(tmr01_div[TCCR1B & 7]))
+ {
+  if (0==++TCNT1)
+   set_flag(&sim.tifr[1], TIMSK1, TOV1);
+  if (TCNT1 == OCR1A)
+   set_flag(&sim.tifr[1], TIMSK1, OCF1A);
+  if (TCNT1 == OCR1B)
+   set_flag(&sim.tifr[1], TIMSK1, OCF1B);
+ }
+
+ if (tmr_clocked(tmr2_div[TCCR2B & 7]))
+ {
+  if (0==++TCNT2)
+   set_flag(&sim.tifr[2], TIMSK2, TOV2);
+  if (TCNT2 == OCR2A)
+   set_flag(&sim.tifr[2], TIMSK2, OCF2A);
+  if (TCNT2 == OCR2B)
+   set_flag(&sim.tifr[2], TIMSK2, OCF2B);
+ }
+}
+
+static void step_adc(void)
+{
+ if (!(ADCSRA & _BV(ADEN)))
+ {
+  sim.adc_cycles = 0;
+  return;
+ }
+
+ if (!sim.adc_cycles)
+ {
+  if (ADCSRA & _BV(ADSC)) //start of conversion, it takes 13 cycles of ADC clock
+   sim.adc_cycles = 13UL * (2 << ((ADCSRA & 7) ? (ADCSRA & 7) - 1 : 0));
+  return;
+ }
+
+ if (sim.adc_cycles > SIM_STEP_CYCLES)
+  sim.adc_cycles-= SIM_STEP_CYCLES;
+ else
+ { //end of conversion
+  sim.adc_cycles = 0;
+  ADC = sim_adc_values[ADMUX & 7] & 0x3FF;
+  ADCSRA&= ~_BV(ADSC);
+  sim.adif = _BV(ADIE);
+ }
+}
+
+/**Calls handlers of pending interrupts, starting from the highest priority one */
+static void dispatch(void)
+{
+ uint8_t i;
+ while(SREG & _BV(SREG_I))
+ {
+  for(i = 0; i < SIM_VECTORS_NUM; ++i)
+  {
+   const sim_vect_t* v = &sim_vectors[i];
+   if ((*v->flg & _BV(v->bit)) && (*v->msk & _BV(v->bit)) && v->handler)
+    break;
+  }
+  if (i == SIM_VECTORS_NUM)
+   break; //nothing is pending
+
+  *sim_vectors[i].flg&= ~_BV(sim_vectors[i].bit); //hardware clears flag when handler is called
+  SREG&= ~_BV(SREG_I);
+  sync_flags();
+  sim_vectors[i].handler();
+  flush_all();
+  SREG|= _BV(SREG_I);                    //reti
+ }
+ sync_flags();
+}
+
+void sim_reset(void)
+{
+ memset(&sim, 0, sizeof(sim));
+ sim_steps = 0;
+ SREG = GPIOR0 = MCUSR = 0;
+ PORTA = DDRA = PINA = PORTB = DDRB = PINB = 0;
+ PORTC = DDRC = PINC = PORTD = DDRD = PIND = 0;
+ TCCR0A = TCCR0B = TCNT0 = OCR0A = OCR0B = TIMSK0 = 0;
+ TCCR1A = TCCR1B = TCCR1C = TIMSK1 = 0;
+ TCNT1 = OCR1A = OCR1B = ICR1 = 0;
+ TCCR2A = TCCR2B = TCNT2 = OCR2A = OCR2B = TIMSK2 = 0;
+ EICRA = EIMSK = EIFR = 0;
+ ADMUX = ADCSRA = ADCSRB = ACSR = 0;
+ ADC = 0;
+ SPCR = SPSR = SPDR = TWBR = TWSR = 0;
+ UCSR0A = UCSR0B = UCSR0C = UBRR0L = UBRR0H = UDR0 = 0;
+ EECR = EEDR = 0;
+ EEAR = 0;
+ WDTCSR = 0;
+ sync_flags();
+}
+
+void sim_step(void)
+{
+ flush_all();
+ sim.cycles+= SIM_STEP_CYCLES;
+ ++sim_steps;
+ step_timers();
+ step_adc();
+ dispatch();
+}
+
+void sim_capture(void)
+{
+ flush_all();
+ ICR1 = TCNT1;
+ set_flag(&sim.tifr[1], TIMSK1, ICF1);
+ sync_flags();
+}
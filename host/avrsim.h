@@ -0,0 +1,60 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+/** \file avrsim.h
+ * \author Alexey A. Shabelnikov
+ * Simulator of ATmega644's timers, ADC and interrupts, used by the host build of the firmware
+ * (Симулятор таймеров, АЦП и прерываний ATmega644 для сборки прошивки на PC).
+ */
+
+#ifndef _HOST_AVRSIM_H_
+#define _HOST_AVRSIM_H_
+
+#include <stdint.h>
+
+/**Number of CPU cycles per one step of simulation. All prescalers used by the firmware are
+ * multiple of this value, so timers are simulated without error */
+#define SIM_STEP_CYCLES 8
+
+/**CPU clock, Hz */
+#define SIM_F_CPU 20000000UL
+
+/**Duration of one step of simulation in seconds */
+#define SIM_STEP_TIME ((double)SIM_STEP_CYCLES / SIM_F_CPU)
+
+/**Number of steps of simulation elapsed since sim_reset() */
+extern uint64_t sim_steps;
+
+/**Values returned by ADC for each of 8 channels (0...1023) */
+extern uint16_t sim_adc_values[8];
+
+/**Puts all registers into their reset state and resets time */
+void sim_reset(void);
+
+/**Performs one step of simulation: advances timers and ADC, then calls handlers of pending
+ * interrupts (if interrupts are enabled globally). Handlers are executed in zero time */
+void sim_step(void);
+
+/**Simulates edge on the ICP1 input (input capture of timer 1). Edge is captured on the current
+ * step, handler will be called by next sim_step() */
+void sim_capture(void);
+
+#endif //_HOST_AVRSIM_H_
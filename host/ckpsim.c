@@ -0,0 +1,368 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+/** \file ckpsim.c
+ * \author Alexey A. Shabelnikov
+ * Host (PC) stimulus harness for the crankshaft position sensor's decoder (ckps.c).
+ * (Тестовый стенд для обработчика ДПКВ, выполняемый на PC).
+ *
+ * Generator synthesizes edges of the crank wheel's teeth (60-2, 36-1 etc) with given RPM profile
+ * and feeds them to the input capture of the simulated MCU (see avrsim.c). The real ISRs of the
+ * firmware (ckps.c, injector.c, adc.c, vstimer.c) process these edges. Harness plays role of the
+ * main loop: it publishes stroke commands (advance angle, dwell time, injection PW) on each stroke
+ * and watches ignition outputs. Moment of each spark is compared with the ideal crank angle, dwell
+ * time is compared with the commanded one. Statistics are printed for each range of RPM.
+ *
+ * Usage: ckpsim [options], see usage() below.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "port/avrio.h"
+#include "port/interrupt.h"
+#include "port/intrinsic.h"
+#include "adc.h"
+#include "camsens.h"
+#include "ckps.h"
+#include "injector.h"
+#include "ioconfig.h"
+#include "knock.h"
+#include "magnitude.h"
+#include "tables.h"
+#include "vstimer.h"
+#include "avrsim.h"
+
+/**Maximum number of ignition outputs watched by harness */
+#define IGN_OUTS_MAX 8
+
+/**Maximum number of RPM ranges in the report */
+#define BANDS_MAX 256
+
+/**Statistics collected for a range of RPM */
+typedef struct
+{
+ uint32_t tdcs;                         //!< number of TDCs passed (number of expected sparks)
+ uint32_t sparks;                       //!< number of sparks
+ uint32_t missed;                       //!< number of TDCs without spark
+ double   err_sum;                      //!< sum of timing errors, degrees
+ double   err_max;                      //!< maximum absolute timing error, degrees
+ uint32_t dwells;                       //!< number of measured dwell periods
+ double   dwl_sum;                      //!< sum of dwell errors, ms
+ double   dwl_max;                      //!< maximum absolute dwell error, ms
+}band_t;
+
+/**Parameters of simulation */
+static struct
+{
+ uint8_t  cogs;                         //!< number of teeth of the crank wheel, including missing
+ uint8_t  miss;                         //!< number of missing teeth
+ uint8_t  cyl;                          //!< number of cylinders
+ uint8_t  btdc;                         //!< number of teeth from missing teeth to TDC of the first cylinder
+ double   adv;                          //!< advance angle, degrees
+ double   dwell;                        //!< dwell time, ms
+ double   rpm_from;                     //!< RPM at the beginning of simulation
+ double   rpm_to;                       //!< RPM at the end of simulation
+ double   time;                         //!< duration of simulation, seconds
+ double   band;                         //!< width of RPM range in the report
+ double   limit;                        //!< maximum allowed timing error (degrees), 0 - not checked
+}cfg = {60, 2, 4, 20, 10.0, 3.0, 50.0, 9000.0, 10.0, 500.0, 0.0};
+
+/**Ignition outputs: I/O register and bit */
+static struct
+{
+ volatile uint8_t* port;
+ uint8_t mask;
+ uint8_t state;                         //!< last state of output
+ double  fall_time;                     //!< time of the last falling edge (beginning of dwell), seconds
+}ign_outs[IGN_OUTS_MAX];
+static uint8_t ign_outs_num = 0;
+
+static band_t bands[BANDS_MAX];
+
+//HIP9011 is not simulated
+void knock_set_integration_mode(uint8_t mode) { (void)mode; }
+void knock_start_settings_latching(void) { }
+
+static void usage(void)
+{
+ printf("Usage: ckpsim [-w cogs-miss] [-c cyl] [-b btdc] [-a adv] [-d dwell] [-r from:to] [-t sec] [-s band] [-e limit]\n");
+ printf(" -w  crank wheel, e.g. 60-2 (default), 36-1\n");
+ printf(" -c  number of cylinders (default 4)\n");
+ printf(" -b  number of teeth from missing teeth to TDC of the 1st cylinder (default 20)\n");
+ printf(" -a  advance angle, degrees (default 10)\n");
+ printf(" -d  dwell time, ms (default 3, used only with DWELL_CONTROL)\n");
+ printf(" -r  RPM profile, linear change from:to (default 50:9000)\n");
+ printf(" -t  duration of simulation, seconds (default 10)\n");
+ printf(" -s  width of RPM range in the report (default 500)\n");
+ printf(" -e  exit with error if timing error exceeds given value, degrees\n");
+}
+
+/**Finds out which port bits are driven by the ignition outputs. Each output is set
+ * through I/O remapping and the changed bit is remembered */
+static void find_ign_outs(void)
+{
+ static const uint8_t ios[IGN_OUTS_MAX] = {IOP_IGN_OUT1, IOP_IGN_OUT2, IOP_IGN_OUT3, IOP_IGN_OUT4,
+                                           IOP_ADD_IO1, IOP_ADD_IO2, IOP_IGN_OUT7, IOP_IGN_OUT8};
+ volatile uint8_t* ports[4] = {&PORTA, &PORTB, &PORTC, &PORTD};
+ uint8_t saved[4], i, p;
+ for(p = 0; p < 4; ++p)
+  saved[p] = *ports[p];
+
+ for(i = 0; i < IGN_OUTS_MAX; ++i)
+ {
+  for(p = 0; p < 4; ++p)
+   *ports[p] = 0;
+  IOCFG_SET(ios[i], 1);
+  for(p = 0; p < 4; ++p)
+   if (*ports[p])
+   {
+    ign_outs[ign_outs_num].port = ports[p];
+    ign_outs[ign_outs_num].mask = *ports[p];
+    ++ign_outs_num;
+    break;
+   }
+ }
+
+ for(p = 0; p < 4; ++p)
+  *ports[p] = saved[p];
+ for(i = 0; i < ign_outs_num; ++i)
+  ign_outs[i].state = !!(*ign_outs[i].port & ign_outs[i].mask);
+}
+
+/**Initialization of firmware's modules, the same order as in secu3.c */
+static void init_firmware(void)
+{
+ ckps_stroke_cmd_t* p_cmd;
+ sim_reset();
+ ckps_init_ports();
+ cams_init_ports();
+#ifdef FUEL_INJECT
+ inject_init_ports();
+#endif
+ adc_init();
+ cams_init_state();
+ ckps_init_state();
+ ckps_set_cyl_number(cfg.cyl);
+ ckps_set_cogs_num(cfg.cogs, cfg.miss);
+ ckps_set_edge_type(1);
+ ckps_set_cogs_btdc(cfg.btdc);
+#ifndef DWELL_CONTROL
+ ckps_set_ignition_cogs(10);
+#endif
+ ckps_set_knock_window(0, ANGLE_MAGNITUDE(25));
+ ckps_use_knock_channel(0);
+ ckps_set_cogs_btdc(cfg.btdc);
+ ckps_set_map_window(0, 0);
+ ckps_set_merge_outs(0);
+#ifdef FUEL_INJECT
+ ckps_set_inj_timing(ANGLE_MAGNITUDE(0), 0);
+ inject_init_state();
+ inject_set_num_squirts(1);          //before number of cylinders, to avoid division by zero on the host
+ inject_set_cyl_number(cfg.cyl);
+ inject_set_fuelcut(1);
+ inject_set_config(0);
+#endif
+ s_timer_init();
+ ckps_enable_ignition(1);
+
+ p_cmd = ckps_get_stroke_cmd();
+ p_cmd->advance_angle = 0;
+#ifdef DWELL_CONTROL
+ p_cmd->acc_time = 0;
+#endif
+#ifdef FUEL_INJECT
+ p_cmd->inj_time = 0;
+#endif
+ ckps_publish_stroke_cmd();
+
+ find_ign_outs();
+ _ENABLE_INTERRUPT();
+}
+
+/**Role of the main loop: publishes stroke command on each stroke */
+static void main_loop(void)
+{
+ if (ckps_is_stroke_event_r())
+ {
+  ckps_stroke_cmd_t* p_cmd = ckps_get_stroke_cmd();
+  p_cmd->advance_angle = (int16_t)lround(cfg.adv * ANGLE_MULTIPLIER);
+#ifdef DWELL_CONTROL
+  p_cmd->acc_time = (uint16_t)lround(cfg.dwell * 312.5);
+#endif
+#ifdef FUEL_INJECT
+  p_cmd->inj_time = 1000; //3.2ms
+#endif
+  ckps_publish_stroke_cmd();
+ }
+}
+
+/**\return band (range of RPM) for given RPM */
+static band_t* get_band(double rpm)
+{
+ int i = (int)(rpm / cfg.band);
+ if (i < 0)
+  i = 0;
+ if (i >= BANDS_MAX)
+  i = BANDS_MAX - 1;
+ return &bands[i];
+}
+
+int main(int argc, char* argv[])
+{
+ int opt, i;
+ double t = 0, angle = 0, next_edge = 0, rpm;
+ double cog_angle, tdc_angle, tdc_step, next_tdc;
+ uint32_t edge_cog = 0; //number of the next tooth in the revolution, 0...cogs-1
+ uint8_t sparked = 0;
+ int32_t tdc_num = 0, first_k = 0;
+ uint8_t hits[4] = {0}; //sparks of the last TDCs, indexed by number of TDC
+ double err_max = 0;
+ uint32_t missed = 0;
+
+ while((opt = getopt(argc, argv, "w:c:b:a:d:r:t:s:e:h")) != -1)
+ {
+  switch(opt)
+  {
+   case 'w': if (2!=sscanf(optarg, "%hhu-%hhu", &cfg.cogs, &cfg.miss)) { usage(); return 2; } break;
+   case 'c': cfg.cyl = atoi(optarg); break;
+   case 'b': cfg.btdc = atoi(optarg); break;
+   case 'a': cfg.adv = atof(optarg); break;
+   case 'd': cfg.dwell = atof(optarg); break;
+   case 'r': if (2!=sscanf(optarg, "%lf:%lf", &cfg.rpm_from, &cfg.rpm_to)) { usage(); return 2; } break;
+   case 't': cfg.time = atof(optarg); break;
+   case 's': cfg.band = atof(optarg); break;
+   case 'e': cfg.limit = atof(optarg); break;
+   default: usage(); return 2;
+  }
+ }
+
+ if (cfg.cogs < 16 || cfg.miss > 2 || cfg.miss < 1 || cfg.cyl < 1 || cfg.cyl > IGN_OUTS_MAX || cfg.band <= 0)
+ {
+  usage();
+  return 2;
+ }
+
+ init_firmware();
+
+ //Tooth 1 (first tooth after missing teeth) is at 0°, TDC of the first cylinder is at tooth btdc
+ cog_angle = 360.0 / cfg.cogs;
+ tdc_step = 720.0 / cfg.cyl;
+ tdc_angle = (cfg.btdc - 1) * cog_angle;
+ next_tdc = tdc_angle;
+
+ while(t < cfg.time)
+ {
+  rpm = cfg.rpm_from + (cfg.rpm_to - cfg.rpm_from) * (t / cfg.time);
+  angle+= rpm * 6.0 * SIM_STEP_TIME;
+  t+= SIM_STEP_TIME;
+
+  //edges of teeth
+  while(angle >= next_edge)
+  {
+   if (edge_cog < (uint32_t)(cfg.cogs - cfg.miss))
+    sim_capture();
+   next_edge+= cog_angle;
+   if (++edge_cog == cfg.cogs)
+    edge_cog = 0;
+  }
+
+  //TDCs passed after the first spark are expected to have a spark each. Spark of the previous TDC is checked
+  //(spark may follow its TDC when advance angle is negative)
+  while(angle >= next_tdc)
+  {
+   if (sparked && tdc_num > first_k)
+   {
+    band_t* b = get_band(rpm);
+    ++b->tdcs;
+    if (!hits[(tdc_num - 1) & 3])
+     ++b->missed;
+    hits[(tdc_num - 1) & 3] = 0;
+   }
+   next_tdc+= tdc_step;
+   ++tdc_num;
+  }
+
+  sim_step();
+  main_loop();
+
+  //watch ignition outputs: rising edge - spark, low level - accumulation of energy (dwell)
+  for(i = 0; i < ign_outs_num; ++i)
+  {
+   uint8_t state = !!(*ign_outs[i].port & ign_outs[i].mask);
+   if (state == ign_outs[i].state)
+    continue;
+   ign_outs[i].state = state;
+   if (state)
+   {
+    band_t* b = get_band(rpm);
+    //find TDC the spark belongs to (nearest to the commanded advance angle)
+    double k = round((angle + cfg.adv - tdc_angle) / tdc_step);
+    double err = (tdc_angle + k * tdc_step - angle) - cfg.adv;
+    ++b->sparks;
+    hits[((int32_t)k) & 3] = 1;
+    b->err_sum+= err;
+    if (fabs(err) > b->err_max)
+     b->err_max = fabs(err);
+#ifdef DWELL_CONTROL
+    if (ign_outs[i].fall_time > 0)
+    {
+     double dwl = (t - ign_outs[i].fall_time) * 1000.0 - cfg.dwell;
+     ++b->dwells;
+     b->dwl_sum+= dwl;
+     if (fabs(dwl) > b->dwl_max)
+      b->dwl_max = fabs(dwl);
+    }
+#endif
+    if (!sparked)
+     sparked = 1, first_k = (int32_t)k;
+   }
+   else
+    ign_outs[i].fall_time = t;
+  }
+ }
+
+ printf("wheel %u-%u, %u cyl., adv. %.2f deg, dwell %.2f ms, %.0f...%.0f min-1 in %.1f s, ckps step %.3f us\n",
+        cfg.cogs, cfg.miss, cfg.cyl, cfg.adv, cfg.dwell, cfg.rpm_from, cfg.rpm_to, cfg.time, SIM_STEP_TIME * 1e6);
+ printf("   RPM range   TDCs sparks  missed  err.avg  err.max  dwl.avg  dwl.max\n");
+ printf("                                     (degrees)          (ms)\n");
+ for(i = 0; i < BANDS_MAX; ++i)
+ {
+  band_t* b = &bands[i];
+  if (!b->tdcs && !b->sparks)
+   continue;
+  missed+= b->missed;
+  if (b->err_max > err_max)
+   err_max = b->err_max;
+  printf("%5.0f-%5.0f %6u %6u %7u %8.3f %8.3f", i * cfg.band, (i + 1) * cfg.band, b->tdcs, b->sparks, b->missed,
+         b->sparks ? b->err_sum / b->sparks : 0.0, b->err_max);
+  if (b->dwells)
+   printf(" %8.3f %8.3f", b->dwl_sum / b->dwells, b->dwl_max);
+  printf("\n");
+ }
+ printf("max. timing error %.3f deg, missed sparks %u\n", err_max, missed);
+
+ if (cfg.limit > 0 && (err_max > cfg.limit || missed))
+  return 1;
+ return 0;
+}
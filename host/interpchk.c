@@ -0,0 +1,261 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+/** \file interpchk.c
+ * \author Alexey A. Shabelnikov
+ * Host (PC) check of interpolation without division (funconv.c).
+ * (Проверка интерполяции без деления, выполняемая на PC).
+ *
+ * Results of simple_interpolation_fr() and bilinear_interpolation_fr() are compared with results of
+ * simple_interpolation() and bilinear_interpolation() (which use division):
+ * 1. For all lengths of interval 1...INTERVAL_MAX and all positions inside interval, with extreme values of function.
+ * 2. For all cells of RPM/MAP tables (f_wrk, inj_ve, inj_afr, f_idl) of all sets stored in the firmware, for each
+ *    RPM (step 1 min-1) and each MAP (step 1 discrete) covering axes of tables. Check is done for linear MAP axis,
+ *    for load grid, for not ascending and for partially filled load grid (linear axis must be used). Operating
+ *    point is calculated by calc_operating_point(), reference point is calculated in the same way as it was done
+ *    before reciprocals were introduced.
+ * Program prints maximum differences and returns 1 if they exceed allowed limits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ecudata.h"
+#include "funconv.h"
+#include "tables.h"
+
+/**Maximum length of interval checked by the first part of check */
+#define INTERVAL_MAX 10000
+
+/**Allowed difference (in LSB of result) for linear interpolation */
+#define SIMPLE_DIFF_MAX   1
+
+/**Allowed difference (in LSB of result) for bilinear interpolation */
+#define BILINEAR_DIFF_MAX 2
+
+/**Load grid used by the second pass of the check (non-linear MAP axis, kPa * 64) */
+static const int16_t test_load_grid[LOAD_GRID_SIZE] =
+ {1280,1600,1920,2240,2560,2880,3200,3520,3840,4160,4480,4800,5120,5440,5920,6400};
+
+/**Reference operating point: arguments of functions which use division */
+typedef struct
+{
+ int8_t  f, fp1, l, lp1;              //!< interpolation nodes
+ int16_t x, x_s, x_l;                 //!< argument, beginning and length of interval on RPM axis
+ int16_t y, y_s, y_l;                 //!< argument, beginning and length of interval on MAP axis
+}refpoint_t;
+
+/**Maximum differences found */
+static struct
+{
+ int16_t simple;
+ int16_t bilinear;
+ uint32_t nodes;                      //!< number of points where interpolation nodes are different
+ uint32_t points;                     //!< number of checked points
+}res;
+
+static void upd_max(int16_t* p_max, int16_t v, int16_t r)
+{
+ int16_t diff = abs(v - r);
+ if (diff > *p_max)
+  *p_max = diff;
+}
+
+/**\return 1 if all sizes of load grid's cells are positive and points are ascending (load grid is used) */
+static uint8_t load_grid_valid(void)
+{
+ uint8_t g;
+ for(g = 0; g < LOAD_GRID_SIZE-1; ++g)
+  if (fw_data.exdata.load_grid_sizes[g] <= 0 || fw_data.exdata.load_grid_points[g+1] <= fw_data.exdata.load_grid_points[g])
+   return 0;
+ return 1;
+}
+
+/**Calculates reference operating point (copy of the code of calc_operating_point() which used division) */
+static void calc_ref_point(int16_t rpm, int16_t map, refpoint_t* r)
+{
+ int8_t f, l;
+ const fw_ex_data_t* ex = &fw_data.exdata;
+
+ for(f = RPM_GRID_SIZE-2; f >= 0; f--)
+  if (rpm >= ex->rpm_grid_points[f]) break;
+ if (f < 0)  {f = 0; rpm = ex->rpm_grid_points[0];}
+ if (rpm > ex->rpm_grid_points[RPM_GRID_SIZE-1]) rpm = ex->rpm_grid_points[RPM_GRID_SIZE-1];
+ r->f = f;
+ r->fp1 = f + 1;
+ r->x = rpm;
+ r->x_s = ex->rpm_grid_points[f];
+ r->x_l = ex->rpm_grid_sizes[f];
+
+ if (load_grid_valid())
+ {
+  int8_t g;
+  int16_t load = map;
+  for(g = LOAD_GRID_SIZE-2; g >= 0; g--)
+   if (load >= ex->load_grid_points[g]) break;
+  if (g < 0)  {g = 0; load = ex->load_grid_points[0];}
+  if (load > ex->load_grid_points[LOAD_GRID_SIZE-1]) load = ex->load_grid_points[LOAD_GRID_SIZE-1];
+  r->l = (LOAD_GRID_SIZE-2) - g;
+  r->lp1 = r->l + 1;
+  r->y = ex->load_grid_points[g+1] - load;
+  r->y_s = 0;
+  r->y_l = ex->load_grid_sizes[g];
+ }
+ else
+ {
+  int16_t discharge, gradient;
+  discharge = (fw_data.def_param.map_upper_pressure - map);
+  if (discharge < 0) discharge = 0;
+  gradient = (fw_data.def_param.map_upper_pressure - fw_data.def_param.map_lower_pressure) / (F_WRK_POINTS_L-1);
+  if (gradient < 1)
+   gradient = 1;
+  l = (discharge / gradient);
+  if (l >= (F_WRK_POINTS_L - 1))
+   r->lp1 = l = F_WRK_POINTS_L - 1;
+  else
+   r->lp1 = l + 1;
+  r->l = l;
+  r->y = discharge;
+  r->y_s = gradient * l;
+  r->y_l = gradient;
+ }
+}
+
+/**Compares bilinear interpolation of the table's cell with reference */
+#define CHECK_MAP(tab) \
+ upd_max(&res.bilinear, \
+   bilinear_interpolation_fr(fn->tab[opp.l][opp.f], fn->tab[opp.lp1][opp.f], fn->tab[opp.lp1][opp.fp1], fn->tab[opp.l][opp.fp1], \
+                             opp.rpm_frac, opp.map_frac), \
+   bilinear_interpolation(r.x, r.y, fn->tab[r.l][r.f], fn->tab[r.lp1][r.f], fn->tab[r.lp1][r.fp1], fn->tab[r.l][r.fp1], \
+                          r.x_s, r.y_s, r.x_l, r.y_l))
+
+/**Checks all cells of tables for current MAP axis */
+static void check_tables(void)
+{
+ struct ecudata_t d;
+ const fw_ex_data_t* ex = &fw_data.exdata;
+ int16_t map_from, map_to, rpm, map;
+ uint8_t k;
+
+ memset(&d, 0, sizeof(d));
+ d.param = fw_data.def_param;
+ operating_point_init();              //load grid may be changed before each check
+ if (load_grid_valid())
+ {
+  map_from = ex->load_grid_points[0];
+  map_to = ex->load_grid_points[LOAD_GRID_SIZE-1];
+ }
+ else
+ {
+  map_from = d.param.map_lower_pressure;
+  map_to = d.param.map_upper_pressure;
+ }
+
+ //beyond axes values are restricted, so a few points outside are enough
+ for(rpm = ex->rpm_grid_points[0] - 10; rpm <= ex->rpm_grid_points[RPM_GRID_SIZE-1] + 10; ++rpm)
+ {
+  for(map = map_from - 10; map <= map_to + 10; ++map)
+  {
+   refpoint_t r;
+   d.sens.inst_frq = rpm;
+   d.sens.map = map;
+   calc_operating_point(&d);
+   calc_ref_point(rpm, map, &r);
+   ++res.points;
+   if (opp.f != r.f || opp.fp1 != r.fp1 || opp.l != r.l || opp.lp1 != r.lp1)
+   {
+    ++res.nodes;
+    continue;
+   }
+   for(k = 0; k < TABLES_NUMBER_PGM; ++k)
+   {
+    const f_data_t* fn = &fw_data.tables[k];
+    d.fn_dat = (f_data_t*)fn;
+    CHECK_MAP(f_wrk);
+    CHECK_MAP(inj_ve);
+    CHECK_MAP(inj_afr);
+    if (bilinear_interpolation_fr(fn->f_wrk[opp.l][opp.f], fn->f_wrk[opp.lp1][opp.f], fn->f_wrk[opp.lp1][opp.fp1],
+        fn->f_wrk[opp.l][opp.fp1], opp.rpm_frac, opp.map_frac) != work_function(&d, 0))
+     ++res.nodes;  //work_function() must use the same nodes and fractions
+    upd_max(&res.simple, simple_interpolation_fr(fn->f_idl[opp.f], fn->f_idl[opp.fp1], opp.rpm_frac, 16),
+            simple_interpolation(r.x, fn->f_idl[r.f], fn->f_idl[r.fp1], r.x_s, r.x_l, 16));
+   }
+  }
+ }
+}
+
+/**Checks all lengths of interval and all positions inside them */
+static void check_intervals(void)
+{
+ static const int16_t a[][2] = {{-128,127},{127,-128},{0,255},{255,0},{0,1},{1,0},{-1,0},{100,-27}};
+ int16_t l, x;
+ uint8_t i;
+
+ for(l = 1; l <= INTERVAL_MAX; ++l)
+ {
+  uint32_t rcp = INTERP_RCP(l);
+  for(x = 0; x <= l; ++x)
+  {
+   uint16_t fx = interp_fraction(x, l, rcp);
+   for(i = 0; i < sizeof(a) / sizeof(a[0]); ++i)
+   {
+    upd_max(&res.simple, simple_interpolation_fr(a[i][0], a[i][1], fx, 16), simple_interpolation(x, a[i][0], a[i][1], 0, l, 16));
+    upd_max(&res.bilinear, bilinear_interpolation_fr(a[i][0], a[i][1], a[i][1], a[i][0], fx, fx),
+            bilinear_interpolation(x, x, a[i][0], a[i][1], a[i][1], a[i][0], 0, 0, l, l));
+   }
+  }
+ }
+}
+
+int main(void)
+{
+ uint8_t g;
+
+ check_intervals();
+ printf("intervals 1...%u: max. difference %d LSB (linear), %d LSB (bilinear)\n", INTERVAL_MAX, res.simple, res.bilinear);
+
+ check_tables();
+ printf("tables, linear MAP axis: max. difference %d LSB (linear), %d LSB (bilinear)\n", res.simple, res.bilinear);
+
+ //the same with load grid (fw_data is an ordinary variable in the host build)
+ for(g = 0; g < LOAD_GRID_SIZE; ++g)
+ {
+  fw_data.exdata.load_grid_points[g] = test_load_grid[g];
+  if (g)
+   fw_data.exdata.load_grid_sizes[g-1] = test_load_grid[g] - test_load_grid[g-1];
+ }
+ check_tables();
+ printf("tables, load grid: max. difference %d LSB (linear), %d LSB (bilinear)\n", res.simple, res.bilinear);
+
+ //grid which is not ascending must not be used (linear axis)
+ fw_data.exdata.load_grid_points[LOAD_GRID_SIZE/2] = fw_data.exdata.load_grid_points[LOAD_GRID_SIZE/2 - 1];
+ check_tables();
+ printf("tables, not ascending load grid: max. difference %d LSB (linear), %d LSB (bilinear)\n", res.simple, res.bilinear);
+ fw_data.exdata.load_grid_points[LOAD_GRID_SIZE/2] = test_load_grid[LOAD_GRID_SIZE/2];
+
+ //grid which is filled partially must not be used (linear axis)
+ fw_data.exdata.load_grid_sizes[LOAD_GRID_SIZE-2] = 0;
+ check_tables();
+ printf("tables, partially filled load grid: max. difference %d LSB (linear), %d LSB (bilinear)\n", res.simple, res.bilinear);
+ printf("%u points checked, %u points with different nodes\n", res.points, res.nodes);
+
+ return (res.simple > SIMPLE_DIFF_MAX || res.bilinear > BILINEAR_DIFF_MAX || res.nodes) ? 1 : 0;
+}
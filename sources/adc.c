@@ -29,11 +29,14 @@
 #include "port/avrio.h"
 #include "port/interrupt.h"
 #include "port/intrinsic.h"
+#include "port/pgmspace.h"
 #include "port/port.h"
 #include <stdlib.h>
 #include "adc.h"
 #include "bitmask.h"
 #include "magnitude.h"
+#include "profiler.h"
+#include "vstimer.h"
 
 /**     */
 #define ADCI_MAP                2
@@ -60,6 +63,50 @@
 /**Tics of TCNT1 timer per 1 second */
 #define TMR_TICKS_PER_SEC 312500L
 
+//Sampling rate classes of channels. Frame of conversions includes all channels which have class
+//less than or equal to the class of frame
+#define ADC_RATE_FAST           0   //!< channel is converted in each frame, including fast frames started by the system timer
+#define ADC_RATE_STROKE         1   //!< channel is converted in each requested frame (engine stroke or forced measurement)
+#define ADC_RATE_SLOW           2   //!< channel is converted in requested frames, but not more often than each ADC_SLOW_PERIOD
+
+/**Minimum period of sampling of slow channels, in 10ms ticks of the system timer (10Hz) */
+#define ADC_SLOW_PERIOD         10
+
+//Logical numbers used for channels which are not a part of schedule
+#define ADCCH_KNOCK             (ADCCH_NUMBER + 0) //!< knock signal
+#define ADCCH_MAPSYN            (ADCCH_NUMBER + 1) //!< crank-synchronous sample of MAP
+#define ADCCH_END               0xFF               //!< used to indicate end of frame
+
+/**Maximum number of samples returned by adc_rb_read(). Two oldest entries are never read
+ * because they may be overwritten by the ISR while we are reading them */
+#define ADC_RB_READ_MAX         (ADC_RB_SIZE - 2)
+
+/**Size of the ring buffer of crank-synchronous MAP samples, must be power of 2 */
+#define ADC_MSRB_SIZE           16
+
+//Bits of requested measurements
+#define ADCRQ_SENS              0x01 //!< measurement of sensors (channels of ADC_RATE_STROKE and ADC_RATE_SLOW classes)
+#define ADCRQ_KNOCK             0x02 //!< measurement of knock signal
+#define ADCRQ_MAPSYN            0x04 //!< crank-synchronous sample of MAP, inserted between channels of any frame
+
+/**Packs number of input and rate class into the entry of sampling schedule */
+#define ADC_SCHED(inp, rate) ((inp) | ((rate) << 4))
+
+/**Sampling schedule, indexed by logical numbers of channels (ADCCH_x). Order of entries defines
+ * order of conversions in the frame */
+PGM_DECLARE(uint8_t adc_sched[ADCCH_NUMBER]) =
+{
+ ADC_SCHED(ADCI_MAP,     ADC_RATE_FAST),
+ ADC_SCHED(ADCI_UBAT,    ADC_RATE_STROKE),
+ ADC_SCHED(ADCI_TEMP,    ADC_RATE_SLOW),
+ ADC_SCHED(ADCI_CARB,    ADC_RATE_FAST),
+ ADC_SCHED(ADCI_ADD_IO1, ADC_RATE_STROKE),
+ ADC_SCHED(ADCI_ADD_IO2, ADC_RATE_STROKE),
+#ifdef PA4_INP_IGNTIM
+ ADC_SCHED(ADCI_PA4,     ADC_RATE_STROKE),
+#endif
+};
+
 #if defined(FUEL_INJECT) || defined(GD_CONTROL)
 /**Used for TPSdot calculations*/
 typedef struct
@@ -72,76 +119,96 @@ typedef struct
 /**C    */
 typedef struct
 {
- volatile uint16_t map_value;    //!<     
- volatile uint16_t ubat_value;   //!<      
- volatile uint16_t temp_value;   //!<      
+ volatile uint16_t rb[ADCCH_NUMBER][ADC_RB_SIZE]; //!< ring buffers of samples, one per channel
+ volatile uint8_t rb_head[ADCCH_NUMBER]; //!< write indexes of ring buffers, changed only by ISR
+ uint8_t rb_tail[ADCCH_NUMBER];   //!< read indexes of ring buffers, changed only by adc_rb_read()
  volatile uint16_t knock_value;  //!<     c () 
- volatile uint16_t add_io1_value;//!< last measured value od ADD_IO1
- volatile uint16_t add_io2_value;//!< last measured value of ADD_IO2
- volatile uint16_t carb_value;   //!< last measured value of TPS
 #if defined(FUEL_INJECT) || defined(GD_CONTROL)
  volatile tpsval_t tpsdot[2];    //!< two value pairs used for TPSdot calculations
 #endif
- volatile uint8_t sensors_ready; //!<       
- uint8_t  measure_all;           //!<  1,     
-#ifdef PA4_INP_IGNTIM
- volatile uint16_t pa4_value;    //!< last measured value from PA4 input
-#endif
+ volatile uint8_t req;           //!< requested measurements (ADCRQ_x), pending or being converted
+ volatile uint8_t busy;          //!< ADC is busy by frame of any type
+ uint8_t  frame_req;             //!< requested measurements served by current frame
+ uint8_t  frame_rate;            //!< rate class of current frame
+ uint8_t  ch;                    //!< logical number of channel which is being converted
+ uint8_t  knock_dummy;           //!< if 1, then first measurement of knock signal is waste (delay)
+ uint8_t  speed2x;               //!< double ADC clock for requested frames
+ uint16_t slow_t;                //!< system time of last sampling of slow channels
+ volatile uint16_t msrb[ADC_MSRB_SIZE];     //!< ring buffer of crank-synchronous MAP samples
+ volatile uint8_t msrb_tag[ADC_MSRB_SIZE];  //!< tags of crank-synchronous MAP samples
+ volatile uint8_t msrb_head;     //!< write index of msrb, changed only by ISR
+ uint8_t  msrb_tail;             //!< read index of msrb, changed only by adc_mapsyn_read()
+ volatile uint8_t mapsyn_tag;    //!< tag of requested crank-synchronous MAP sample
+ uint8_t  mapsyn_tag_cur;        //!< tag of crank-synchronous MAP sample which is being converted
+ uint8_t  resume;                //!< channel of the frame to be converted after crank-synchronous MAP sample
 }adcstate_t;
 
 /**    */
 adcstate_t adc;
 
-uint16_t adc_get_map_value(void)
+uint16_t adc_get_value(uint8_t ch)
 {
  uint16_t value;
  _BEGIN_ATOMIC_BLOCK();
- value = adc.map_value;
+ value = adc.rb[ch][(uint8_t)(adc.rb_head[ch] - 1) & (ADC_RB_SIZE - 1)];
  _END_ATOMIC_BLOCK();
  return value;
 }
 
+uint8_t adc_rb_read(uint8_t ch, uint16_t* p_sum)
+{
+ uint8_t i, head = adc.rb_head[ch]; //single byte, so it is read atomically
+ uint8_t n = head - adc.rb_tail[ch];
+ uint16_t sum = 0;
+ if (n > ADC_RB_READ_MAX)
+  n = ADC_RB_READ_MAX;              //overrun, take only most recent samples
+ adc.rb_tail[ch] = head;
+ for(i = n; i; --i)
+  sum+= adc.rb[ch][(uint8_t)(head - i) & (ADC_RB_SIZE - 1)];
+ *p_sum = sum;
+ return n;
+}
+
+uint8_t adc_mapsyn_read(uint16_t* p_value, uint8_t* p_tag)
+{
+ uint8_t idx, head = adc.msrb_head; //single byte, so it is read atomically
+ if (head == adc.msrb_tail)
+  return 0;                         //no new samples
+ if ((uint8_t)(head - adc.msrb_tail) > (ADC_MSRB_SIZE - 2))
+  adc.msrb_tail = head - (ADC_MSRB_SIZE - 2); //overrun, skip oldest samples
+ idx = adc.msrb_tail & (ADC_MSRB_SIZE - 1);
+ *p_value = adc.msrb[idx];
+ *p_tag = adc.msrb_tag[idx];
+ ++adc.msrb_tail;
+ return 1;
+}
+
+uint16_t adc_get_map_value(void)
+{
+ return adc_get_value(ADCCH_MAP);
+}
+
 uint16_t adc_get_ubat_value(void)
 {
- uint16_t value;
- _BEGIN_ATOMIC_BLOCK();
- value = adc.ubat_value;
- _END_ATOMIC_BLOCK();
- return value;
+ return adc_get_value(ADCCH_UBAT);
 }
 
 uint16_t adc_get_temp_value(void)
 {
- uint16_t value;
- _BEGIN_ATOMIC_BLOCK();
- value = adc.temp_value;
- _END_ATOMIC_BLOCK();
- return value;
+ return adc_get_value(ADCCH_TEMP);
 }
 
 uint16_t adc_get_add_io1_value(void)
 {
- uint16_t value;
- _BEGIN_ATOMIC_BLOCK();
- value = adc.add_io1_value;
- _END_ATOMIC_BLOCK();
- return value;
+ return adc_get_value(ADCCH_ADD_IO1);
 }
 uint16_t adc_get_add_io2_value(void)
 {
- uint16_t value;
- _BEGIN_ATOMIC_BLOCK();
- value = adc.add_io2_value;
- _END_ATOMIC_BLOCK();
- return value;
+ return adc_get_value(ADCCH_ADD_IO2);
 }
 uint16_t adc_get_carb_value(void)
 {
- uint16_t value;
- _BEGIN_ATOMIC_BLOCK();
- value = adc.carb_value;
- _END_ATOMIC_BLOCK();
- return value;
+ return adc_get_value(ADCCH_CARB);
 }
 #if defined(FUEL_INJECT) || defined(GD_CONTROL)
 int16_t adc_get_tpsdot_value(void)
@@ -174,160 +241,235 @@ uint16_t adc_get_knock_value(void)
 #ifdef PA4_INP_IGNTIM
 uint16_t adc_get_pa4_value(void)
 {
- uint16_t value;
- _BEGIN_ATOMIC_BLOCK();
- value = adc.pa4_value;
- _END_ATOMIC_BLOCK();
- return value;
+ return adc_get_value(ADCCH_PA4);
 }
 #endif
 
-void adc_begin_measure(uint8_t speed2x)
+/**Starts conversion of specified channel
+ * \param ch logical number of channel (ADCCH_x, ADCCH_KNOCK or ADCCH_MAPSYN)
+ */
+static void start_channel(uint8_t ch)
 {
- //     ,    
- // 
- if (!adc.sensors_ready)
-  return;
+ adc.ch = ch;
+ if (ch < ADCCH_NUMBER)
+  ADMUX = (PGM_GET_BYTE(&adc_sched[ch]) & 0x07)|ADC_VREF_TYPE;
+ else if (ch == ADCCH_KNOCK)
+  ADMUX = ADCI_KNOCK|ADC_VREF_TYPE;
+ else
+  ADMUX = ADCI_MAP|ADC_VREF_TYPE;
+ SETBIT(ADCSRA, ADSC);
+}
+
+/**Finds channel of current frame, beginning from specified one
+ * \param ch logical number of channel to begin search from
+ * \return logical number of found channel, ADCCH_NUMBER if there are no more channels in the frame
+ */
+static uint8_t next_channel(uint8_t ch)
+{
+ for(; ch < ADCCH_NUMBER; ++ch)
+  if ((PGM_GET_BYTE(&adc_sched[ch]) >> 4) <= adc.frame_rate)
+   break;
+ return ch;
+}
+
+static void start_frame(uint8_t fast);
+
+/**Starts conversion of the next channel of current frame. Requested crank-synchronous sample of MAP
+ * has priority and is inserted before it. If frame is finished, then frame of measurements which were
+ * requested while ADC was busy is started. Must be called with disabled interrupts
+ * \param next logical number of the next channel of the frame, ADCCH_END if frame is finished
+ */
+static void convert_next(uint8_t next)
+{
+ if (adc.req & ADCRQ_MAPSYN)
+ {
+  adc.req&= ~ADCRQ_MAPSYN;
+  adc.mapsyn_tag_cur = adc.mapsyn_tag;
+  adc.resume = next;
+  start_channel(ADCCH_MAPSYN);
+ }
+ else if (next != ADCCH_END)
+  start_channel(next);
+ else
+ { //frame is finished
+  adc.req&= ~adc.frame_req;
+  if (adc.req)
+   start_frame(0);
+  else
+   adc.busy = 0;
+ }
+}
 
- adc.sensors_ready = 0;
- ADMUX = ADCI_MAP|ADC_VREF_TYPE;
- if (speed2x)
+/**Starts new frame of conversions. Requested measurements will be served by the frame.
+ * Must be called with disabled interrupts
+ * \param fast 1 - perform fast frame if there are no requested measurements
+ */
+static void start_frame(uint8_t fast)
+{
+ adc.busy = 1;
+ adc.frame_req = adc.req & (ADCRQ_SENS | ADCRQ_KNOCK);
+ if (adc.speed2x)
   CLEARBIT(ADCSRA, ADPS0); //250kHz
  else
   SETBIT(ADCSRA, ADPS0);   //125kHz
- SETBIT(ADCSRA, ADSC);
+
+ if (adc.frame_req & ADCRQ_SENS)
+ {
+  adc.frame_rate = ADC_RATE_STROKE;
+  if ((sys_counter - adc.slow_t) >= ADC_SLOW_PERIOD)
+  { //it is time to sample slow channels (interrupts are disabled, so we can read sys_counter directly)
+   adc.frame_rate = ADC_RATE_SLOW;
+   adc.slow_t = sys_counter;
+  }
+ }
+ else if (adc.frame_req & ADCRQ_KNOCK)
+ { //knock only
+  adc.knock_dummy = 1;   //<--one measurement delay will be used
+  convert_next(ADCCH_KNOCK);
+  return;
+ }
+ else if (fast)
+  adc.frame_rate = ADC_RATE_FAST;
+ else
+ { //empty frame, only crank-synchronous sample of MAP
+  convert_next(ADCCH_END);
+  return;
+ }
+
+ convert_next(next_channel(0));
 }
 
-void adc_begin_measure_knock(uint8_t speed2x)
+/**Requests measurement. Measurement starts immediately if ADC is idle, or after completion of current fast frame.
+ * \param req requested measurements (ADCRQ_x)
+ * \param speed2x Double ADC clock (0,1)
+ */
+static void request_measure(uint8_t req, uint8_t speed2x)
 {
+ _BEGIN_ATOMIC_BLOCK();
  //     ,    
  // 
- if (!adc.sensors_ready)
-  return;
+ if (!(adc.req & (ADCRQ_SENS | ADCRQ_KNOCK)))
+ {
+  adc.req|= req;
+  adc.speed2x = speed2x;
+  if (!adc.busy)
+   start_frame(0);
+ }
+ _END_ATOMIC_BLOCK();
+}
 
- adc.sensors_ready = 0;
- adc.measure_all = 1;   //<--one measurement delay will be used
- ADMUX = ADCI_KNOCK|ADC_VREF_TYPE;
- if (speed2x)
-  CLEARBIT(ADCSRA, ADPS0); //250kHz
- else
-  SETBIT(ADCSRA, ADPS0);   //125kHz
- SETBIT(ADCSRA, ADSC);
+void adc_begin_measure(uint8_t speed2x)
+{
+ request_measure(ADCRQ_SENS, speed2x);
+}
+
+void adc_begin_measure_knock(uint8_t speed2x)
+{
+ request_measure(ADCRQ_KNOCK, speed2x);
 }
 
 void adc_begin_measure_all(void)
 {
- adc.measure_all = 1;
- adc_begin_measure(0); //<--normal speed
+ request_measure(ADCRQ_SENS | ADCRQ_KNOCK, 0); //<--normal speed
+}
+
+void adc_begin_measure_fast(void)
+{
+ _BEGIN_ATOMIC_BLOCK();
+ if (!adc.busy)
+  start_frame(1);        //there are no requests if ADC is idle, so it will be fast frame
+ _END_ATOMIC_BLOCK();
+}
+
+void adc_begin_measure_map(uint8_t tag)
+{
+ _BEGIN_ATOMIC_BLOCK();
+ adc.mapsyn_tag = tag;
+ adc.req|= ADCRQ_MAPSYN;
+ if (!adc.busy)
+  start_frame(0);
+ _END_ATOMIC_BLOCK();
 }
 
 uint8_t adc_is_measure_ready(void)
 {
- return adc.sensors_ready;
+ return !(adc.req & (ADCRQ_SENS | ADCRQ_KNOCK));
 }
 
 void adc_init(void)
 {
  adc.knock_value = 0;
- adc.measure_all = 0;
+ adc.req = 0;
+ adc.busy = 0;
+ adc.slow_t = sys_counter - ADC_SLOW_PERIOD; //slow channels will be sampled in the first frame
 
  // , : f = 125.000 kHz,
  //         VREF_5V,  
  ADMUX=ADC_VREF_TYPE;
  ADCSRA=_BV(ADEN)|_BV(ADIE)|_BV(ADPS2)|_BV(ADPS1)|_BV(ADPS0);
 
- //     
- adc.sensors_ready = 1;
-
  //  -    
  ACSR=_BV(ACD);
 }
 
-/**    .     .  
- *        ,         .
+/**    . Conversion of each channel of the frame in the order given by
+ * schedule, results are put into ring buffers of channels. After starting of the frame this interrupt will be
+ * called for each channel of the frame until all channels are processed. Crank-synchronous samples of MAP are
+ * inserted between channels of the frame and are put into separate ring buffer.
  */
 ISR(ADC_vect)
 {
+ uint8_t ch, next;
+ uint16_t value;
+ ISRPROF_BEGIN();
  _ENABLE_INTERRUPT();
 
- switch(ADMUX&0x07)
- {
-  case ADCI_MAP: //   
-   adc.map_value = ADC;
-   ADMUX = ADCI_UBAT|ADC_VREF_TYPE;
-   SETBIT(ADCSRA,ADSC);
-   break;
-
-  case ADCI_UBAT://    
-   adc.ubat_value = ADC;
-   ADMUX = ADCI_TEMP|ADC_VREF_TYPE;
-   SETBIT(ADCSRA,ADSC);
-   break;
-
-  case ADCI_TEMP://    
-   adc.temp_value = ADC;
-   ADMUX = ADCI_CARB|ADC_VREF_TYPE;
-   SETBIT(ADCSRA,ADSC);
-   break;
+ ch = adc.ch;
+ value = ADC;
 
-  case ADCI_CARB:
-   adc.carb_value = ADC;
-   ADMUX = ADCI_ADD_IO1|ADC_VREF_TYPE;
-   SETBIT(ADCSRA,ADSC);
+ if (ch == ADCCH_KNOCK && adc.knock_dummy)
+ {                      //waste measurement is required (for delay)
+  adc.knock_dummy = 0;
+  SETBIT(ADCSRA,ADSC);  //change nothing and start ADC again
+ }
+ else
+ {
+  if (ch == ADCCH_KNOCK)  //      
+  {
+   adc.knock_value = value;
+   next = ADCCH_END;
+  }
+  else if (ch == ADCCH_MAPSYN)
+  {
+   adc.msrb[adc.msrb_head & (ADC_MSRB_SIZE - 1)] = value;
+   adc.msrb_tag[adc.msrb_head & (ADC_MSRB_SIZE - 1)] = adc.mapsyn_tag_cur;
+   ++adc.msrb_head;
+   next = adc.resume;     //continue interrupted frame
+  }
+  else
+  {
+   adc.rb[ch][adc.rb_head[ch] & (ADC_RB_SIZE - 1)] = value;
+   ++adc.rb_head[ch];
 
 #if defined(FUEL_INJECT) || defined(GD_CONTROL)
-   if ((TCNT1 - adc.tpsdot[1].tps_tmr) >= TPSDOT_TIME_DELTA)
+   if (ch == ADCCH_CARB && (TCNT1 - adc.tpsdot[1].tps_tmr) >= TPSDOT_TIME_DELTA)
    {
     //save values for TPSdot calculations
     adc.tpsdot[1] = adc.tpsdot[0];          //previous = current
-    adc.tpsdot[0].tps_volt = ADC;           //save voltage
+    adc.tpsdot[0].tps_volt = value;         //save voltage
     adc.tpsdot[0].tps_tmr = TCNT1;          //save timer value
    }
 #endif
-   break;
-
-  case ADCI_ADD_IO1:
-   adc.add_io1_value = ADC;
-   ADMUX = ADCI_ADD_IO2|ADC_VREF_TYPE;
-   SETBIT(ADCSRA,ADSC);
-   break;
-
-  case ADCI_ADD_IO2:
-   adc.add_io2_value = ADC;
-
-#ifdef PA4_INP_IGNTIM
-   ADMUX = ADCI_PA4|ADC_VREF_TYPE;
-   SETBIT(ADCSRA,ADSC);
-   break;
-
-  case ADCI_PA4:
-   adc.pa4_value = ADC;
-#endif
-   if (0==adc.measure_all)
-   {
-    ADMUX = ADCI_MAP|ADC_VREF_TYPE;
-    adc.sensors_ready = 1; //finished
-   }
-   else
-   { //continue (knock)
-    adc.measure_all = 0;
-    ADMUX = ADCI_KNOCK|ADC_VREF_TYPE;
-    SETBIT(ADCSRA,ADSC);
-   }
-   break;
-
-  case ADCI_KNOCK://      
-   if (adc.measure_all)
-   {                      //waste measurement is required (for delay)
-    adc.measure_all = 0;
-    SETBIT(ADCSRA,ADSC);  //change nothing and start ADC again
-    break;
-   }
-
-   adc.knock_value = ADC;
-   adc.sensors_ready = 1;
-   break;
+   next = next_channel(ch + 1);
+   if (next == ADCCH_NUMBER)
+    next = (adc.frame_req & ADCRQ_KNOCK) ? ADCCH_KNOCK : ADCCH_END; //continue (knock) or finish
+  }
+
+  _DISABLE_INTERRUPT();
+  convert_next(next);
+  _ENABLE_INTERRUPT();
  }
+ ISRPROF_END(ISRPROF_ADC);
 }
 
 int16_t adc_compensate(int16_t adcvalue, int16_t factor, int32_t correction)
@@ -49,6 +49,49 @@
  #define ADC_VREF_FACTOR        1.0000  //!< Vref compensation factor (2.56V/2.56V)
 #endif
 
+/**Bit of tag of crank-synchronous MAP sample, indicates last sample in the window of cylinder */
+#define ADC_MAPSYN_LAST         0x80
+
+//Logical numbers of analog channels (sensors). They also define order of conversions
+#define ADCCH_MAP               0       //!< MAP sensor
+#define ADCCH_UBAT              1       //!< board voltage
+#define ADCCH_TEMP              2       //!< coolant temperature sensor
+#define ADCCH_CARB              3       //!< throttle position sensor
+#define ADCCH_ADD_IO1           4       //!< ADD_IO1 input
+#define ADCCH_ADD_IO2           5       //!< ADD_IO2 input
+#ifdef PA4_INP_IGNTIM
+#define ADCCH_PA4               6       //!< PA4 input
+#define ADCCH_NUMBER            7       //!< number of channels
+#else
+#define ADCCH_NUMBER            6       //!< number of channels
+#endif
+
+/**Size of the ring buffer of samples of each channel, must be power of 2 */
+#define ADC_RB_SIZE             8
+
+/** Get latest sample of specified channel
+ * \param ch logical number of channel (ADCCH_x)
+ * \return value in ADC discretes
+ */
+uint16_t adc_get_value(uint8_t ch);
+
+/** Read samples of specified channel which were put into its ring buffer since previous call.
+ * There is one reader for each channel (measure.c), so access is lock-free. If buffer overruns,
+ * then only the most recent samples are returned.
+ * \param ch logical number of channel (ADCCH_x)
+ * \param p_sum pointer to variable which will receive sum of read samples
+ * \return number of read samples, can be 0 (e.g. slow channel was not sampled since previous call)
+ */
+uint8_t adc_rb_read(uint8_t ch, uint16_t* p_sum);
+
+/** Read next crank-synchronous sample of MAP (see adc_begin_measure_map()). Samples are read in
+ * the order they were taken. There is one reader (measure.c), so access is lock-free
+ * \param p_value pointer to variable which will receive value of sample (ADC discretes)
+ * \param p_tag pointer to variable which will receive tag of sample
+ * \return 1 - sample was read, 0 - there are no new samples
+ */
+uint8_t adc_mapsyn_read(uint16_t* p_value, uint8_t* p_tag);
+
 /**      
  * \return    
  */
@@ -111,8 +154,19 @@ void adc_begin_measure_knock(uint8_t speed2x);
  */
 void adc_begin_measure_all(void);
 
+/**Starts fast frame of conversions: only channels which require high sampling rate (MAP, TPS) are converted.
+ * Frame is not started if ADC is busy. Called by the system timer (each 1.6ms)
+ */
+void adc_begin_measure_fast(void);
+
+/**Requests crank-synchronous sample of MAP. Sample is converted as soon as possible: immediately if ADC is idle,
+ * otherwise between channels of the current frame. Called by the CKP module on each tooth of the MAP sampling window
+ * \param tag tag which will be saved together with the sample (number of cylinder, ADC_MAPSYN_LAST bit)
+ */
+void adc_begin_measure_map(uint8_t tag);
+
 /**  
- *\return   0    (  )
+ *\return   0    (requested measurement is finished, fast frames are not taken into account)
  */
 uint8_t adc_is_measure_ready(void);
 
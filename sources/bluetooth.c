@@ -92,6 +92,7 @@ static void append_tx_buff_with_at_baud_cmd(uint16_t baud)
  else if (baud == CBR_19200) uart_append_send_buff('5');
  else if (baud == CBR_38400) uart_append_send_buff('6');
  else if (baud == CBR_57600) uart_append_send_buff('7');
+ else if (baud == CBR_115200) uart_append_send_buff('8');
 }
 
 /** Increments SM state if timer expired (baud rate setting)*/
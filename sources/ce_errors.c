@@ -34,6 +34,7 @@
 #include "ckps.h"
 #include "ecudata.h"
 #include "eeprom.h"
+#include "injector.h"
 #include "ioconfig.h"
 #include "knock.h"
 #include "magnitude.h"
@@ -83,6 +84,18 @@ void check(struct ecudata_t* d)
   ce_clear_error(ECUERROR_CKPS_MALFUNCTION);
  }
 
+#ifdef FUEL_INJECT
+ if (inject_is_error())
+ {
+  ce_set_error(ECUERROR_INJ_QUEUE_OVERFLOW);
+  inject_reset_error();
+ }
+ else
+ {
+  ce_clear_error(ECUERROR_INJ_QUEUE_OVERFLOW);
+ }
+#endif
+
 #ifdef PHASE_SENSOR
  if (cams_is_error())
  {
@@ -160,7 +173,7 @@ void check(struct ecudata_t* d)
   else
    ce_clear_error(ECUERROR_VOLT_SENSOR_FAIL);
 
-  ce_state.bv_tdc = 800; //init debouncing counter
+  ce_state.bv_tdc = 50; //init debouncing counter (0.5 sec, because ce_check_engine() is called each 10ms)
  }
  else if (1==ce_state.bv_eds) //voltage is not OK
  {
@@ -189,7 +202,7 @@ void check(struct ecudata_t* d)
 //If any error occurs, the CE is light up for a fixed time. If the problem persists (eg corrupted the program code),
 //then the CE will be turned on continuously. At the start of program CE lights up for 0.5 seconds. for indicating
 //of the operability.
-void ce_check_engine(struct ecudata_t* d, volatile s_timer8_t* ce_control_time_counter)
+void ce_check_engine(struct ecudata_t* d, s_timer_t* ce_control_time_counter)
 {
  uint16_t temp_errors;
 
@@ -35,7 +35,10 @@
 //define bits (numbers of bits) of errors (Check Engine)
 #define ECUERROR_CKPS_MALFUNCTION       0  //!< CKP sensor malfunction
 #define ECUERROR_EEPROM_PARAM_BROKEN    1  //!< Parameters in EEPROM are broken. CE turns off after a few seconds after the engine starts
-#define ECUERROR_PROGRAM_CODE_BROKEN    2  //!< FLASH is broken. CE turns off after a few seconds after the engine starts
+/**FLASH is broken. Firmware is checked continuously in the background (one chunk per pass of the main loop), so this
+ * error is set again after each full pass which ends with CRC mismatch. Error is cleared after a few seconds after the
+ * engine starts, but the first pass may complete after that, so CE can turn on again while engine is running */
+#define ECUERROR_PROGRAM_CODE_BROKEN    2
 #define ECUERROR_KSP_CHIP_FAILED        3  //!< Knock detection chip does not work properly
 #define ECUERROR_KNOCK_DETECTED         4  //!< Knock was detected (one or many times)
 #define ECUERROR_MAP_SENSOR_FAIL        5  //!< MAP sensor does not work
@@ -44,6 +47,7 @@
 #define ECUERROR_DWELL_CONTROL          8  //!< Problems with dwell control (overcharge etc)
 #define ECUERROR_CAMS_MALFUNCTION       9  //!< CAM sensor malfunction
 #define ECUERROR_TPS_SENSOR_FAIL       10  //!< TPS sensor does not work
+#define ECUERROR_INJ_QUEUE_OVERFLOW    11  //!< Injection pulse was skipped because queue of events was full (full sequential mode)
 
 struct ecudata_t;
 
@@ -51,7 +55,7 @@ struct ecudata_t;
  * \param d pointer to ECU data structure
  * \param ce_control_time_counter time counter object
  */
-void ce_check_engine(struct ecudata_t* d, volatile s_timer8_t* ce_control_time_counter);
+void ce_check_engine(struct ecudata_t* d, s_timer_t* ce_control_time_counter);
 
 /**Set specified error (number of bit)
  * \param error code of error
@@ -38,6 +38,7 @@
 #include "ioconfig.h"
 #include "injector.h"   //inject_start_inj()
 #include "magnitude.h"
+#include "profiler.h"
 #include "tables.h"     //fnptr_t
 
 #include "knock.h"
@@ -76,6 +77,32 @@
  *    . */
 #define COMPA_VECT_DELAY 2
 
+/**Number of fractional bits in the reciprocal of degrees_per_cog (see cogs_per_degree) */
+#define COG_RCP_SHIFT 24
+
+/**Number of fractional bits in the part of tooth left before spark (max. value is 2.0, so result fits into 16 bits) */
+#define COG_FRC_SHIFT 14
+
+/**Maximum number of crank wheel's teeth (see ckps_set_cogs_num()) */
+#define CKPS_COGS_MAX 200
+
+/**Maximum number of teeth in the MAP sampling window (see ckps_set_map_window()) */
+#define MAP_WND_COGS_MAX 60
+
+// Actions performed on tooth (bits of the cog_actions table's entries)
+#define CA_KNKBEG    0                //!< open phase selection window for knock detection
+#define CA_KNKEND    1                //!< close window and start measurement of integrated knock signal
+#define CA_LATCH     2                //!< latch advance angle, start measurements
+#define CA_STROKE    3                //!< TDC, measure period between strokes
+#ifdef HALL_OUTPUT
+ #define CA_HOPBEG   4                //!< Hall output: beginning of pulse
+ #define CA_HOPEND   5                //!< Hall output: end of pulse
+#endif
+#ifdef FUEL_INJECT
+ #define CA_INJBEG   6                //!< beginning of fuel injection
+#endif
+#define CA_MAPWND    7                //!< beginning of the crank-synchronous MAP sampling window
+
 // Flags (see flags variable)
 #define F_ERROR     0                 //!< CKP error flag, set in the CKP's interrupt, reset after processing (  ,     ,   ) 
 #define F_VHTPER    1                 //!< used to indicate that measured period is valid (actually measured)
@@ -97,6 +124,9 @@
 #endif
 #define F_CALTIM     2                //!< Indicates that time calculation is started before the spark
 #define F_SPSIGN     3                //!< Sign of the measured stroke period (time between TDCs)
+#ifdef FUEL_INJECT
+ #define F_INJEND    4                //!< Injection timing defines end of pulse, start of pulse is predicted on each tooth
+#endif
 
 /** State variables */
 typedef struct
@@ -110,7 +140,6 @@ typedef struct
  uint16_t current_angle;              //!< counts out given advance angle during the passage of each tooth (      )
  volatile uint16_t stroke_period;     //!< stores the last measurement of the passage of teeth n (     n )
  int16_t  advance_angle;              //!< required adv.angle * ANGLE_MULTIPLIER (  * ANGLE_MULTIPLIER)
- volatile int16_t advance_angle_buffered;//!< buffered value of advance angle (to ensure correct latching)
  uint8_t  ignition_cogs;              //!< number of teeth determining the duration of ignition drive pulse (-      )
  uint8_t  starting_mode;              //!< state of state machine processing of teeth at the startup (      )
  uint8_t  channel_mode;               //!< determines which channel of the ignition to run at the moment (        )
@@ -132,8 +161,15 @@ typedef struct
  uint8_t  hop_duration;               //!< Hall output: duration of pulse in teeth of wheel
 #endif
 #ifdef FUEL_INJECT
- int16_t  inj_phase;                  //!< Injection timing: start of pulse in teeth of wheel relatively to TDC
+ int16_t  inj_phase;                  //!< Injection timing: start (or end) of pulse in teeth of wheel relatively to TDC
+ volatile uint16_t inj_frc;           //!< Injection timing: part of tooth between reference tooth and start (or end) of pulse, * 2^COG_FRC_SHIFT
+ volatile uint16_t inj_pw;            //!< Injection PW latched from the stroke command (timer's ticks), used to predict start of pulse
+ uint8_t  inj_chan;                   //!< Injection channel which end of pulse is expected next (end of pulse timing)
 #endif
+ int16_t  map_wnd_begin_abs;          //!< beginning of the MAP sampling window in teeth of wheel relatively to TDC
+ uint8_t  map_wnd_cogs;               //!< number of teeth in the MAP sampling window, 0 - crank-synchronous sampling of MAP is off
+ uint8_t  map_cnt;                    //!< counts out teeth of the current MAP sampling window
+ uint8_t  map_chan;                   //!< channel (cylinder) the current MAP sampling window belongs to
  volatile uint8_t wheel_cogs_num;     //!< Number of teeth, including absent ( ,  )
  volatile uint8_t wheel_cogs_nump1;   //!< wheel_cogs_num + 1
  volatile uint8_t wheel_cogs_numm1;   //!< wheel_cogs_num - 1
@@ -147,6 +183,7 @@ typedef struct
   */
  volatile uint8_t  wheel_latch_btdc;
  volatile uint16_t degrees_per_cog;   //!< Number of degrees which corresponds to the 1 tooth (      )
+ volatile uint32_t cogs_per_degree;   //!< Reciprocal of degrees_per_cog, multiplied by 2^COG_RCP_SHIFT (used instead of division in ISR)
  volatile uint16_t cogs_per_chan;     //!< Number of teeth per 1 ignition channel (it is fractional number * 256)
  volatile int16_t start_angle;        //!< Precalculated value of the advance angle at 66 (at least) BTDC
 #ifdef STROBOSCOPE
@@ -180,8 +217,9 @@ typedef struct
 #endif
 
 #ifdef FUEL_INJECT
- volatile uint16_t inj_begin_cog;      //!< Injection timing: tooth number that corresponds to the beginning of pulse
+ volatile uint16_t inj_cog;            //!< Injection timing: tooth number that corresponds to the beginning of pulse (or reference tooth before the end of pulse)
 #endif
+ volatile uint16_t map_wnd_begin;      //!< tooth number that corresponds to the beginning of the MAP sampling window
 
  /** Determines number of tooth (relatively to TDC) at which "latching" of data is performed (   ( ...)    "" ) */
  volatile uint16_t cogs_latch;
@@ -196,6 +234,21 @@ typedef struct
 ckpsstate_t ckps;                         //!< instance of state variables
 chanstate_t chanstate[IGN_CHANNELS_MAX];  //!< instance of array of channel's state variables
 
+/**Double buffer of stroke commands. Main loop fills buffer which is not published, ISR latches
+ * published one at the beginning of each stroke (see ckps_get_stroke_cmd(), ckps_publish_stroke_cmd()) */
+ckps_stroke_cmd_t stroke_cmd[2];
+volatile uint8_t stroke_cmd_idx = 0;     //!< index of published stroke command
+
+/**Actions for each tooth of 720 (index = number of tooth - 1, see CA_xxx bits). Table is built from reference
+ * points of all channels, so ISR performs single lookup per tooth instead of comparing with each reference point */
+uint8_t cog_actions[CKPS_COGS_MAX * 2];
+
+/**Set action on specified tooth (numeration of teeth begins from 1) */
+#define COG_ACT_SET(cog, act) SETBIT(cog_actions[(cog) - 1], (act))
+
+/**Remove action from specified tooth (numeration of teeth begins from 1) */
+#define COG_ACT_CLR(cog, act) CLEARBIT(cog_actions[(cog) - 1], (act))
+
 // Arrange flags in the free I/O register (    /)
 //  note: may be not effective on other MCUs or even case bugs! Be aware.
 #define flags  GPIOR0                 //!< ATmega644 has one general purpose I/O register and we use it for first flags variable
@@ -233,11 +286,18 @@ void ckps_init_state_variables(void)
 
  ckps.cog = ckps.cog360 = 0;
  ckps.stroke_period = 0xFFFF;
- ckps.advance_angle = ckps.advance_angle_buffered = 0;
+ ckps.advance_angle = 0;
  ckps.starting_mode = 0;
  ckps.channel_mode = CKPS_CHANNEL_MODENA;
+#ifdef FUEL_INJECT
+ ckps.inj_chan = CKPS_CHANNEL_MODENA;  //channel will be selected after synchronization
+#endif
+ ckps.map_cnt = 0;
 #ifdef PHASED_IGNITION
  CLEARBIT(flags2, F_CAMISS);
+#ifdef FUEL_INJECT
+ inject_set_phased(0); //phase will be known again after event from cam sensor
+#endif
 #endif
  CLEARBIT(flags, F_NTSCHA);
  CLEARBIT(flags, F_STROKE);
@@ -276,11 +336,14 @@ void ckps_init_state(void)
  _END_ATOMIC_BLOCK();
 }
 
-void ckps_set_advance_angle(int16_t angle)
+ckps_stroke_cmd_t* ckps_get_stroke_cmd(void)
 {
- _BEGIN_ATOMIC_BLOCK();
- ckps.advance_angle_buffered = angle;
- _END_ATOMIC_BLOCK();
+ return &stroke_cmd[stroke_cmd_idx ^ 1];
+}
+
+void ckps_publish_stroke_cmd(void)
+{
+ stroke_cmd_idx^= 1; //single byte write, so atomic block is not needed
 }
 
 void ckps_init_ports(void)
@@ -363,8 +426,12 @@ static uint16_t _normalize_tn(int16_t i_tn)
 void ckps_set_cogs_btdc(uint8_t cogs_btdc)
 {
  uint8_t _t, i;
+ uint16_t c;
  _t=_SAVE_INTERRUPT();
  _DISABLE_INTERRUPT();
+ //all reference points will be recalculated, so build table of actions from scratch
+ for(c = 0; c < ckps.wheel_cogs_num2; ++c)
+  cog_actions[c] = 0;
  for(i = 0; i < ckps.chan_number; ++i)
  {
   uint16_t tdc = (((uint16_t)cogs_btdc) + ((i * ckps.cogs_per_chan) >> 8));
@@ -378,8 +445,23 @@ void ckps_set_cogs_btdc(uint8_t cogs_btdc)
   chanstate[i].hop_end_cog = _normalize_tn(chanstate[i].hop_begin_cog + ckps.hop_duration);
 #endif
 #ifdef FUEL_INJECT
-  chanstate[i].inj_begin_cog = _normalize_tn(tdc - ckps.inj_phase);
+  chanstate[i].inj_cog = _normalize_tn(tdc - ckps.inj_phase);
+#endif
+  chanstate[i].map_wnd_begin = _normalize_tn(tdc - ckps.map_wnd_begin_abs);
+  COG_ACT_SET(chanstate[i].cogs_btdc, CA_STROKE);
+  COG_ACT_SET(chanstate[i].cogs_latch, CA_LATCH);
+  COG_ACT_SET(chanstate[i].knock_wnd_begin, CA_KNKBEG);
+  COG_ACT_SET(chanstate[i].knock_wnd_end, CA_KNKEND);
+#ifdef HALL_OUTPUT
+  COG_ACT_SET(chanstate[i].hop_begin_cog, CA_HOPBEG);
+  COG_ACT_SET(chanstate[i].hop_end_cog, CA_HOPEND);
+#endif
+#ifdef FUEL_INJECT
+  if (!CHECKBIT(flags2, F_INJEND))
+   COG_ACT_SET(chanstate[i].inj_cog, CA_INJBEG);
 #endif
+  if (ckps.map_wnd_cogs)
+   COG_ACT_SET(chanstate[i].map_wnd_begin, CA_MAPWND);
  }
  ckps.cogs_btdc = cogs_btdc;
  _RESTORE_INTERRUPT(_t);
@@ -392,13 +474,6 @@ void ckps_set_ignition_cogs(uint8_t cogs)
  ckps.ignition_cogs = cogs;
  _END_ATOMIC_BLOCK();
 }
-#else
-void ckps_set_acc_time(uint16_t i_acc_time)
-{
- _BEGIN_ATOMIC_BLOCK();
- ckps.cr_acc_time = i_acc_time;
- _END_ATOMIC_BLOCK();
-}
 #endif
 
 uint8_t ckps_is_error(void)
@@ -479,6 +554,9 @@ static void set_channels_fs(uint8_t fs_mode)
   chanstate[i].io_callback2 = get_callback(iss);
   _RESTORE_INTERRUPT(_t);
  }
+#ifdef FUEL_INJECT
+ inject_set_phased(fs_mode); //full sequential injection depends on cam sensor too
+#endif
 }
 #endif
 
@@ -505,7 +583,7 @@ void ckps_set_cyl_number(uint8_t i_cyl_number)
    ((iocfg_pfn_set)get_callback(i))(IGN_OUTPUTS_ON_VAL);
 
  //TODO: calculations previosly made by ckps_set_cogs_btdc()|ckps_set_knock_window()|ckps_set_hall_pulse() becomes invalid!
- //So, ckps_set_cogs_btdc() must be called again. Do it here or in place where this function called.
+ //So, ckps_set_cogs_btdc() must be called again (it also rebuilds table of actions). Do it here or in place where this function called.
 }
 
 void ckps_set_knock_window(int16_t begin, int16_t end)
@@ -517,11 +595,53 @@ void ckps_set_knock_window(int16_t begin, int16_t end)
 
  _t=_SAVE_INTERRUPT();
  _DISABLE_INTERRUPT();
+ //remove old actions of all channels first, because new tooth of one channel may be equal to old tooth of another
+ for(i = 0; i < ckps.chan_number; ++i)
+ {
+  COG_ACT_CLR(chanstate[i].knock_wnd_begin, CA_KNKBEG);
+  COG_ACT_CLR(chanstate[i].knock_wnd_end, CA_KNKEND);
+ }
  for(i = 0; i < ckps.chan_number; ++i)
  {
   uint16_t tdc = (((uint16_t)ckps.cogs_btdc) + ((i * ckps.cogs_per_chan) >> 8));
   chanstate[i].knock_wnd_begin = _normalize_tn(tdc + ckps.knock_wnd_begin_abs);
   chanstate[i].knock_wnd_end = _normalize_tn(tdc + ckps.knock_wnd_end_abs);
+  COG_ACT_SET(chanstate[i].knock_wnd_begin, CA_KNKBEG);
+  COG_ACT_SET(chanstate[i].knock_wnd_end, CA_KNKEND);
+ }
+ _RESTORE_INTERRUPT(_t);
+}
+
+void ckps_set_map_window(int16_t begin, int16_t width)
+{
+ uint8_t _t, i;
+ uint16_t cogs = 0;
+ //translate from degrees to teeth (    )
+ ckps.map_wnd_begin_abs = begin / ((int16_t)ckps.degrees_per_cog);
+ if (width > 0)
+ {
+  cogs = ((uint16_t)width) / ckps.degrees_per_cog;
+  if (!cogs)
+   cogs = 1;                             //at least one sample per window
+  if (cogs > (ckps.cogs_per_chan >> 8))
+   cogs = ckps.cogs_per_chan >> 8;       //windows of cylinders must not overlap
+  if (cogs > MAP_WND_COGS_MAX)
+   cogs = MAP_WND_COGS_MAX;
+ }
+
+ _t=_SAVE_INTERRUPT();
+ _DISABLE_INTERRUPT();
+ //remove old actions of all channels first, because new tooth of one channel may be equal to old tooth of another
+ for(i = 0; i < ckps.chan_number; ++i)
+  COG_ACT_CLR(chanstate[i].map_wnd_begin, CA_MAPWND);
+ ckps.map_wnd_cogs = cogs;
+ ckps.map_cnt = 0;
+ for(i = 0; i < ckps.chan_number; ++i)
+ {
+  uint16_t tdc = (((uint16_t)ckps.cogs_btdc) + ((i * ckps.cogs_per_chan) >> 8));
+  chanstate[i].map_wnd_begin = _normalize_tn(tdc - ckps.map_wnd_begin_abs);
+  if (cogs)
+   COG_ACT_SET(chanstate[i].map_wnd_begin, CA_MAPWND);
  }
  _RESTORE_INTERRUPT(_t);
 }
@@ -547,10 +667,17 @@ void ckps_set_hall_pulse(int8_t i_offset, uint8_t i_duration)
  _t=_SAVE_INTERRUPT();
  _DISABLE_INTERRUPT();
  for(i = 0; i < ckps.chan_number; ++i)
+ {
+  COG_ACT_CLR(chanstate[i].hop_begin_cog, CA_HOPBEG);
+  COG_ACT_CLR(chanstate[i].hop_end_cog, CA_HOPEND);
+ }
+ for(i = 0; i < ckps.chan_number; ++i)
  {
   uint16_t tdc = (((uint16_t)ckps.cogs_btdc) + ((i * ckps.cogs_per_chan) >> 8));
   chanstate[i].hop_begin_cog = _normalize_tn(tdc - ckps.hop_offset);
   chanstate[i].hop_end_cog = _normalize_tn(chanstate[i].hop_begin_cog + ckps.hop_duration);
+  COG_ACT_SET(chanstate[i].hop_begin_cog, CA_HOPBEG);
+  COG_ACT_SET(chanstate[i].hop_end_cog, CA_HOPEND);
  }
  _RESTORE_INTERRUPT(_t);
 }
@@ -563,6 +690,7 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
  uint16_t err_thrd = (norm_num * 2) + (norm_num >> 3); //+ 12.5%
 #endif
  uint16_t cogs_per_chan, degrees_per_cog;
+ uint32_t cogs_per_degree;
 
  //precalculate number of cogs per 1 ignition channel, it is fractional number multiplied by 256
  cogs_per_chan = (((uint32_t)(norm_num * 2)) << 8) / ckps.chan_number;
@@ -574,6 +702,9 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
  //e.g. for 60-2 crank wheel result = 11 (66), for 36-1 crank wheel result = 7 (70)
  dr = div(ANGLE_MAGNITUDE(66), degrees_per_cog);
 
+ //precalculate reciprocal of degrees per 1 cog (rounded), it is used to avoid division in the ISR
+ cogs_per_degree = ((1UL << COG_RCP_SHIFT) + (degrees_per_cog >> 1)) / degrees_per_cog;
+
  _t=_SAVE_INTERRUPT();
  _DISABLE_INTERRUPT();
  //calculate number of last cog
@@ -588,6 +719,7 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
  //set other precalculated values
  ckps.wheel_latch_btdc = dr.quot + (dr.rem > 0);
  ckps.degrees_per_cog = degrees_per_cog;
+ ckps.cogs_per_degree = cogs_per_degree;
  ckps.cogs_per_chan = cogs_per_chan;
  ckps.start_angle = ckps.degrees_per_cog * ckps.wheel_latch_btdc;
 #ifdef PHASE_SENSOR
@@ -597,26 +729,95 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
 }
 
 #ifdef FUEL_INJECT
-void ckps_set_inj_timing(int16_t phase)
+void ckps_set_inj_timing(int16_t phase, uint8_t pulse_end)
 {
  uint8_t _t, i;
- //TODO: We can do some optimization in the future - set timing only if it is not equal to current (already set one)
+ int16_t inj_phase;
+ uint16_t inj_frc = 0;
 
  //convert from 0..720 BTDC to -360...360
  phase-= ANGLE_MAGNITUDE(360);
 
- //save values because we will access them from other function
- //Also, convert form crank degrees to teeth
- ckps.inj_phase = phase / ((int16_t)ckps.degrees_per_cog);
-
- for(i = 0; i < ckps.chan_number; ++i)
+ //convert form crank degrees to teeth
+ inj_phase = phase / ((int16_t)ckps.degrees_per_cog);
+ if (pulse_end || inject_is_delay_supported())
  {
-  uint16_t tdc = (((uint16_t)ckps.cogs_btdc) + ((i * ckps.cogs_per_chan) >> 8));
-  uint16_t timing = _normalize_tn(tdc - ckps.inj_phase); //current inj.timing
+  //reference tooth is the nearest tooth before the beginning (end) of pulse (round up), remaining part of tooth is
+  //counted out by timer (beginning of pulse) or used in the prediction of the start of pulse (end of pulse).
+  //In other modes delay is not supported, so pulse starts on the tooth obtained by truncation, as before
+  if (inj_phase * (int16_t)ckps.degrees_per_cog < phase)
+   ++inj_phase;
+  inj_frc = (((uint32_t)(inj_phase * (int16_t)ckps.degrees_per_cog - phase)) * ckps.cogs_per_degree) >> (COG_RCP_SHIFT - COG_FRC_SHIFT);
+ }
+
  _t=_SAVE_INTERRUPT();
  _DISABLE_INTERRUPT();
-  chanstate[i].inj_begin_cog = timing;
+ ckps.inj_frc = inj_frc;
+ //This function is called on each engine stroke, so do nothing if timing is not changed (in teeth)
+ if (inj_phase != ckps.inj_phase || pulse_end != (CHECKBIT(flags2, F_INJEND) > 0))
+ {
+  //save values because we will access them from other function
+  ckps.inj_phase = inj_phase;
+  WRITEBIT(flags2, F_INJEND, pulse_end);
+  ckps.inj_chan = CKPS_CHANNEL_MODENA;  //select channel again
+  //remove old actions of all channels first, because new tooth of one channel may be equal to old tooth of another
+  for(i = 0; i < ckps.chan_number; ++i)
+   COG_ACT_CLR(chanstate[i].inj_cog, CA_INJBEG);
+  for(i = 0; i < ckps.chan_number; ++i)
+  {
+   uint16_t tdc = (((uint16_t)ckps.cogs_btdc) + ((i * ckps.cogs_per_chan) >> 8));
+   chanstate[i].inj_cog = _normalize_tn(tdc - ckps.inj_phase); //current inj.timing
+   if (!pulse_end)
+    COG_ACT_SET(chanstate[i].inj_cog, CA_INJBEG); //in the end of pulse mode start is predicted on each tooth
+  }
+ }
  _RESTORE_INTERRUPT(_t);
+}
+#endif
+
+#ifdef FUEL_INJECT
+/** Calculates number of teeth remaining to the specified tooth
+ * \param cog Number of tooth
+ * \return number of teeth from the current tooth (0...wheel_cogs_num2-1)
+ */
+INLINE
+static int16_t cogs_to(uint16_t cog)
+{
+ int16_t rem = cog - ckps.cog;
+ if (rem < 0)
+  rem+= ckps.wheel_cogs_num2;
+ return rem;
+}
+
+/** Predicts start of injection pulse when injection timing defines end of pulse. Called on each tooth.
+ * Time remaining to the end of pulse is extrapolated using the last inter-tooth period (like dwell time,
+ * see acc_delay) and injection starts when less than one tooth remains to the back-calculated start of pulse.
+ * The rest of time (sub-tooth delay) is counted out by the injector module.
+ */
+INLINE
+static void predict_inj_start(void)
+{
+ uint32_t time;
+ if (CKPS_CHANNEL_MODENA == ckps.inj_chan)
+ { //select channel which has the nearest end of pulse
+  uint8_t i;
+  int16_t rem, min_rem = ckps.wheel_cogs_num2;
+  for(i = 0; i < ckps.chan_number; ++i)
+  {
+   rem = cogs_to(chanstate[i].inj_cog);
+   if (rem < min_rem)
+    min_rem = rem, ckps.inj_chan = i;
+  }
+ }
+
+ //time remaining to the end of pulse of the next channel
+ time = ((uint32_t)ckps.period_curr) * cogs_to(chanstate[ckps.inj_chan].inj_cog);
+ time+= (((uint32_t)ckps.period_curr) * ckps.inj_frc) >> COG_FRC_SHIFT;
+ if (time < ((uint32_t)ckps.inj_pw + ckps.period_curr))
+ { //start of pulse comes before the next tooth, if it is too late (PW has increased), then start immediately
+  inject_start_inj_delayed(ckps.inj_chan, (time > ckps.inj_pw) ? time - ckps.inj_pw : 0);
+  if (++ckps.inj_chan >= ckps.chan_number)
+   ckps.inj_chan = 0;
  }
 }
 #endif
@@ -806,7 +1007,7 @@ static uint8_t sync_at_startup(void)
  */
 static void process_ckps_cogs(void)
 {
- uint8_t i;
+ uint8_t i, actions;
 
  force_pending_spark();
 
@@ -814,11 +1015,12 @@ static void process_ckps_cogs(void)
  if (ckps.channel_mode_b != CKPS_CHANNEL_MODENA)
  {
   //We must take into account time elapsed between last spark and following tooth.
-  //Because ICR1 can not be less than tmrval_saved we are using addition modulo 65535
-  //to calculate difference (elapsed time).
+  //Because ICR1 can not be less than tmrval_saved we are using subtraction modulo 65536
+  //to calculate difference (elapsed time). Result is casted to 16 bits explicitly, so it does not
+  //depend on size of int (firmware's sources are also compiled on the host, see host/ckpsim.c)
   if (!CHECKBIT(flags2, F_ADDPTK))
   {
-   ckps.acc_delay-=((uint16_t)(~ckps.tmrval_saved)) + 1 + GetICR();
+   ckps.acc_delay-=(uint16_t)(GetICR() - ckps.tmrval_saved);
    SETBIT(flags2, F_ADDPTK);
   }
   //Correct our prediction on each cog
@@ -838,18 +1040,38 @@ static void process_ckps_cogs(void)
 
  force_pending_spark();
 
- for(i = 0; i < ckps.chan_number; ++i)
+ //all actions scheduled for current tooth (0 if tooth number is out of range, e.g. synchronization is lost)
+ actions = (ckps.cog <= ckps.wheel_cogs_num2) ? cog_actions[ckps.cog - 1] : 0;
+
+ if (CHECKBIT(actions, CA_MAPWND))
+ {
+  //beginning of the MAP sampling window, find channel this tooth belongs to (happens only once per stroke)
+  for(i = 0; i < ckps.chan_number; ++i)
+   if (ckps.cog == chanstate[i].map_wnd_begin)
+    break;
+  ckps.map_chan = i;
+  ckps.map_cnt = ckps.map_wnd_cogs;
+ }
+
+ //sample MAP on each tooth of the window. Sample is requested before other measurements started on this tooth
+ if (ckps.map_cnt)
+ {
+  --ckps.map_cnt;
+  adc_begin_measure_map(ckps.map_chan | (ckps.map_cnt ? 0 : ADC_MAPSYN_LAST));
+ }
+
+ if (actions)
  {
   if (CHECKBIT(flags, F_USEKNK))
   {
    //start listening a detonation (opening the window)
    //   ( )
-   if (ckps.cog == chanstate[i].knock_wnd_begin)
+   if (CHECKBIT(actions, CA_KNKBEG))
     knock_set_integration_mode(KNOCK_INTMODE_INT);
 
    //finish listening a detonation (closing the window) and start the process of measuring integrated value
    //   ( )      
-   if (ckps.cog == chanstate[i].knock_wnd_end)
+   if (CHECKBIT(actions, CA_KNKEND))
    {
     knock_set_integration_mode(KNOCK_INTMODE_HOLD);
     adc_begin_measure_knock(_AB(ckps.stroke_period, 1) < 4);
@@ -860,13 +1082,28 @@ static void process_ckps_cogs(void)
   //before this moment value was stored in a temporary buffer.
   // 66   ..        , 
   //     .
-  if (ckps.cog == chanstate[i].cogs_latch)
+  if (CHECKBIT(actions, CA_LATCH))
   {
+   //find channel this tooth belongs to (happens only once per stroke)
+   for(i = 0; i < ckps.chan_number; ++i)
+    if (ckps.cog == chanstate[i].cogs_latch)
+     break;
    ckps.channel_mode = (i & ckps.chan_mask); //remember number of channel (  )
    SETBIT(flags, F_NTSCHA);                  //establish an indication that it is need to count advance angle (  ,    )
    //start counting of advance angle (   )
    ckps.current_angle = ckps.start_angle; // those same 66 (  66)
-   ckps.advance_angle = ckps.advance_angle_buffered; //advance angle with all the adjustments (say, 15)(    (, 15))
+   //latch stroke command published by the main loop, all its values belong to the same pass
+   {
+    ckps_stroke_cmd_t* p_cmd = &stroke_cmd[stroke_cmd_idx];
+    ckps.advance_angle = p_cmd->advance_angle; //advance angle with all the adjustments (say, 15)(    (, 15))
+#ifdef DWELL_CONTROL
+    ckps.cr_acc_time = p_cmd->acc_time;
+#endif
+#ifdef FUEL_INJECT
+    inject_set_inj_time(p_cmd->inj_time);
+    ckps.inj_pw = p_cmd->inj_time;
+#endif
+   }
    knock_start_settings_latching();//start the process of downloading the settings into the HIP9011 (     HIP)
    adc_begin_measure(_AB(ckps.stroke_period, 1) < 4);//start the process of measuring analog input values (     )
 #ifdef STROBOSCOPE
@@ -881,7 +1118,7 @@ static void process_ckps_cogs(void)
   //then remember current value of count for the next measurement
   //( /     - ...     ,
   //       )
-  if (ckps.cog==chanstate[i].cogs_btdc)
+  if (CHECKBIT(actions, CA_STROKE))
   {
    //save period value if it is correct
    if (CHECKBIT(flags, F_VHTPER))
@@ -897,18 +1134,29 @@ static void process_ckps_cogs(void)
   }
 
 #ifdef HALL_OUTPUT
-  if (ckps.cog == chanstate[i].hop_begin_cog)
+  if (CHECKBIT(actions, CA_HOPBEG))
    IOCFG_SET(IOP_HALL_OUT, 1);
-  if (ckps.cog == chanstate[i].hop_end_cog)
+  if (CHECKBIT(actions, CA_HOPEND))
    IOCFG_SET(IOP_HALL_OUT, 0);
 #endif
 
 #ifdef FUEL_INJECT
-  if (ckps.cog == chanstate[i].inj_begin_cog)
-   inject_start_inj(i);      //start fuel injection
+  if (CHECKBIT(actions, CA_INJBEG))
+  {
+   //beginning of pulse is between this and next tooth, so rest of angle is converted to time
+   uint16_t delay = (((uint32_t)ckps.period_curr) * ckps.inj_frc) >> COG_FRC_SHIFT;
+   for(i = 0; i < ckps.chan_number; ++i)
+    if (ckps.cog == chanstate[i].inj_cog)
+     inject_start_inj_delayed(i, delay); //start fuel injection
+  }
 #endif
  }
 
+#ifdef FUEL_INJECT
+ if (CHECKBIT(flags2, F_INJEND) && ckps.cog <= ckps.wheel_cogs_num2)
+  predict_inj_start();
+#endif
+
  force_pending_spark();
 
  //Preparing to start the ignition for the current channel (if the right moment became)
@@ -920,11 +1168,11 @@ static void process_ckps_cogs(void)
   {
    //before starting the ignition it is left to count less than 2 teeth. It is necessary to prepare the compare module
    //(      2-x .    )
-   //TODO: replace heavy division by multiplication with magic number. This will reduce up to 40uS !
-   if (ckps.period_curr < 128)
-    OCR1A = GetICR() + ((diff * (ckps.period_curr)) / ckps.degrees_per_cog) - COMPA_VECT_DELAY;
-   else
-    OCR1A = GetICR() + (((uint32_t)diff * (ckps.period_curr)) / ckps.degrees_per_cog) - COMPA_VECT_DELAY;
+   //Time = diff * period / degrees_per_cog. Division is replaced by multiplication with precalculated reciprocal:
+   //fraction of tooth (0...2, * 2^COG_FRC_SHIFT) is calculated first, then it is multiplied by the inter-tooth period.
+   //Product is rounded, because truncated reciprocal and fraction both make time shorter.
+   uint16_t frac = (diff * ckps.cogs_per_degree) >> (COG_RCP_SHIFT - COG_FRC_SHIFT);
+   OCR1A = GetICR() + (((uint32_t)ckps.period_curr * frac + (1UL << (COG_FRC_SHIFT - 1))) >> COG_FRC_SHIFT) - COMPA_VECT_DELAY;
    TIFR1 = _BV(OCF1A);
    TIMSK1|=_BV(OCIE1A);       // enable Compare A interrupt
    CLEARBIT(flags, F_NTSCHA); // For avoiding to enter into setup mode (       )
@@ -993,6 +1241,7 @@ static void process_ckps_cogs(void)
  */
 ISR(TIMER1_CAPT_vect)
 {
+ ISRPROF_BEGIN();
  force_pending_spark();
 
  ckps.period_curr = GetICR() - ckps.icr_prev;
@@ -1005,6 +1254,7 @@ ISR(TIMER1_CAPT_vect)
  {
   if (sync_at_startup())
    goto sync_enter;
+  ISRPROF_END(ISRPROF_CKPS);
   return;
  }
 
@@ -1048,6 +1298,7 @@ sync_enter:
  ckps.period_prev = ckps.period_curr;
 
  force_pending_spark();
+ ISRPROF_END(ISRPROF_CKPS);
 }
 
 /**Purpose of this interrupt handler is to supplement timer up to 16 bits and call procedure
@@ -1056,6 +1307,7 @@ sync_enter:
  *      16-  ). */
 ISR(TIMER0_COMPA_vect)
 {
+ ISRPROF_BEGIN();
  if (TCNT0_H)  //Did high byte exhaust (   ) ?
  {
   --TCNT0_H;
@@ -1076,6 +1328,7 @@ ISR(TIMER0_COMPA_vect)
   process_ckps_cogs();
   ++ckps.cog360;
  }
+ ISRPROF_END(ISRPROF_T0COMPA);
 }
 
 /** Timer 1 overflow interrupt.
@@ -70,18 +70,32 @@ void ckps_set_cogs_btdc(uint8_t cogs_btdc);
  *  10,     40.     60-2  4-  ).
  */
 void ckps_set_ignition_cogs(uint8_t cogs);
-#else
-/**Dwell control. Set accumulation time
- * \param i_acc_time accumulation time in timer's ticks (1 tick = 4uS)
+#endif
+
+/**Describes set of values which must be applied to the engine stroke all together
+ * ( ,       )
  */
-void ckps_set_acc_time(uint16_t i_acc_time);
+typedef struct
+{
+ int16_t advance_angle;                 //!< advance angle * ANGLE_MULTIPLIER ()
+#ifdef DWELL_CONTROL
+ uint16_t acc_time;                     //!< accumulation time in timer's ticks (    )
+#endif
+#ifdef FUEL_INJECT
+ uint16_t inj_time;                     //!< injection pulse width in ticks of timer ( )
 #endif
+}ckps_stroke_cmd_t;
 
-/** Set andvance angle
- * (     )
- * \param angle advance angle * ANGLE_MULTIPLIER
+/** Get stroke command record which is not used by the ISR now. Caller must fill all fields
+ * of this record and then call ckps_publish_stroke_cmd()
+ * \return pointer to the stroke command which can be filled by the main loop
  */
-void ckps_set_advance_angle(int16_t angle);
+ckps_stroke_cmd_t* ckps_get_stroke_cmd(void);
+
+/** Publish stroke command record previously obtained by ckps_get_stroke_cmd(). All values
+ * of the record will be latched by the ISR at once, at the beginning of the next engine stroke
+ */
+void ckps_publish_stroke_cmd(void);
 
 /** Calculate instant RPM using last measured period
  * (          )
@@ -166,11 +180,21 @@ void ckps_set_shutter_spark(uint8_t i_shutter);
 void ckps_set_shutter_wnd_width(int16_t width);
 #endif
 
+/** Set crank angle window in which MAP is sampled for each cylinder (on each tooth of the window).
+ * Must be called after ckps_set_cogs_btdc(). Crank-synchronous sampling of MAP is supported only by
+ * the 60-2 decoder (ckps.c)
+ * \param begin Beginning of the window in degrees of wheel before TDC of compression stroke (0...720) * ANGLE_MULTIPLIER
+ * \param width Width of the window in degrees of wheel * ANGLE_MULTIPLIER, 0 - sampling is off
+ */
+void ckps_set_map_window(int16_t begin, int16_t width);
+
 #ifdef FUEL_INJECT
 /** Set injection timing relatively to TDC (value in crankshaft degrees BTDC)
  * \param phase Injection timing in degrees of wheel * ANGLE_MULTIPLIER
+ * \param pulse_end 0 - timing defines beginning of pulse, 1 - timing defines end of pulse (start of pulse
+ * will be predicted using current RPM and PW). End of pulse is supported only by the 60-2 decoder (ckps.c)
  */
-void ckps_set_inj_timing(int16_t phase);
+void ckps_set_inj_timing(int16_t phase, uint8_t pulse_end);
 #endif
 
 #endif //_CKPS_H_
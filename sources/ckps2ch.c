@@ -44,6 +44,7 @@
 #include "injector.h"   //inject_start_inj()
 #include "ioconfig.h"
 #include "magnitude.h"
+#include "profiler.h"
 #include "tables.h"     //fnptr_t
 
 #include "knock.h"
@@ -82,6 +83,12 @@
  *    . */
 #define COMPA_VECT_DELAY 2
 
+/**Number of fractional bits in the reciprocal of degrees_per_cog (see cogs_per_degree) */
+#define COG_RCP_SHIFT 24
+
+/**Number of fractional bits in the part of tooth left before spark (max. value is 2.0, so result fits into 16 bits) */
+#define COG_FRC_SHIFT 14
+
 // Flags (see flags variable)
 #define F_ERROR     0                 //!< CKP error flag, set in the CKP's interrupt, reset after processing (  ,     ,   ) 
 #define F_VHTPER    1                 //!< used to indicate that measured period is valid (actually measured)
@@ -107,7 +114,6 @@ typedef struct
  uint16_t current_angle;              //!< counts out given advance angle during the passage of each tooth (      )
  volatile uint16_t stroke_period;     //!< stores the last measurement of the passage of teeth n (     n )
  int16_t  advance_angle;              //!< required adv.angle * ANGLE_MULTIPLIER (  * ANGLE_MULTIPLIER)
- volatile int16_t advance_angle_buffered;//!< buffered value of advance angle (to ensure correct latching)
  uint8_t  starting_mode;              //!< state of state machine processing of teeth at the startup (      )
  uint8_t  channel_mode;               //!< determines which channel of the ignition to run at the moment (        )
  volatile uint8_t cogs_btdc;          //!< number of teeth from missing teeth to TDC of the first cylinder (-     ..  )
@@ -136,6 +142,7 @@ typedef struct
   */
  volatile uint8_t  wheel_latch_btdc;
  volatile uint16_t degrees_per_cog;   //!< Number of degrees which corresponds to the 1 tooth (      )
+ volatile uint32_t cogs_per_degree;   //!< Reciprocal of degrees_per_cog, multiplied by 2^COG_RCP_SHIFT (used instead of division in ISR)
  volatile uint16_t cogs_per_chan;     //!< Number of teeth per 1 ignition channel (it is fractional number * 256)
  volatile int16_t start_angle;        //!< Precalculated value of the advance angle at 66 (at least) BTDC
 #ifdef STROBOSCOPE
@@ -181,6 +188,11 @@ typedef struct
 ckpsstate_t ckps;                         //!< instance of state variables
 chanstate_t chanstate[IGN_CHANNELS_MAX];  //!< instance of array of channel's state variables
 
+/**Double buffer of stroke commands. Main loop fills buffer which is not published, ISR latches
+ * published one at the beginning of each stroke (see ckps_get_stroke_cmd(), ckps_publish_stroke_cmd()) */
+ckps_stroke_cmd_t stroke_cmd[2];
+volatile uint8_t stroke_cmd_idx = 0;     //!< index of published stroke command
+
 /** Arrange flags in the free I/O register (    /) 
  *  note: may be not effective on other MCUs or even case bugs! Be aware.
  */
@@ -205,7 +217,7 @@ void ckps_init_state_variables(void)
  _BEGIN_ATOMIC_BLOCK();
  ckps.cog = ckps.cog360 = 0;
  ckps.stroke_period = 0xFFFF;
- ckps.advance_angle = ckps.advance_angle_buffered = 0;
+ ckps.advance_angle = 0;
  ckps.starting_mode = 0;
  ckps.channel_mode = CKPS_CHANNEL_MODENA;
  CLEARBIT(flags, F_NTSCHA);
@@ -246,11 +258,14 @@ void ckps_init_state(void)
  _END_ATOMIC_BLOCK();
 }
 
-void ckps_set_advance_angle(int16_t angle)
+ckps_stroke_cmd_t* ckps_get_stroke_cmd(void)
 {
- _BEGIN_ATOMIC_BLOCK();
- ckps.advance_angle_buffered = angle;
- _END_ATOMIC_BLOCK();
+ return &stroke_cmd[stroke_cmd_idx ^ 1];
+}
+
+void ckps_publish_stroke_cmd(void)
+{
+ stroke_cmd_idx^= 1; //single byte write, so atomic block is not needed
 }
 
 void ckps_init_ports(void)
@@ -491,6 +506,11 @@ void ckps_set_knock_window(int16_t begin, int16_t end)
  _RESTORE_INTERRUPT(_t);
 }
 
+void ckps_set_map_window(int16_t begin, int16_t width)
+{
+ //not supported in this implementation
+}
+
 void ckps_enable_ignition(uint8_t i_cutoff)
 {
  WRITEBIT(flags, F_IGNIEN, i_cutoff);
@@ -528,6 +548,7 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
  uint16_t err_thrd = (norm_num * 2) + (norm_num >> 3); //+ 12.5%
 #endif
  uint16_t cogs_per_chan, degrees_per_cog;
+ uint32_t cogs_per_degree;
 
  //precalculate number of cogs per 1 ignition channel, it is fractional number multiplied by 256
  cogs_per_chan = (((uint32_t)(norm_num * 2)) << 8) / ckps.chan_number;
@@ -539,6 +560,9 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
  //e.g. for 60-2 crank wheel result = 11 (66), for 36-1 crank wheel result = 7 (70)
  dr = div(ANGLE_MAGNITUDE(66), degrees_per_cog);
 
+ //precalculate reciprocal of degrees per 1 cog (rounded), it is used to avoid division in the ISR
+ cogs_per_degree = ((1UL << COG_RCP_SHIFT) + (degrees_per_cog >> 1)) / degrees_per_cog;
+
  _t=_SAVE_INTERRUPT();
  _DISABLE_INTERRUPT();
  //calculate number of last cog
@@ -553,6 +577,7 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
  //set other precalculated values
  ckps.wheel_latch_btdc = dr.quot + (dr.rem > 0);
  ckps.degrees_per_cog = degrees_per_cog;
+ ckps.cogs_per_degree = cogs_per_degree;
  ckps.cogs_per_chan = cogs_per_chan;
  ckps.start_angle = ckps.degrees_per_cog * ckps.wheel_latch_btdc;
 #ifdef PHASE_SENSOR
@@ -562,7 +587,7 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
 }
 
 #ifdef FUEL_INJECT
-void ckps_set_inj_timing(int16_t phase)
+void ckps_set_inj_timing(int16_t phase, uint8_t pulse_end)
 {
  uint8_t _t, i;
  //TODO: We can do some optimization in the future - set timing only if it is not equal to current (already set one)
@@ -715,7 +740,14 @@ static void process_ckps_cogs(void)
    SETBIT(flags, F_NTSCHA);                  //establish an indication that it is need to count advance angle (  ,    )
    //start counting of advance angle (   )
    ckps.current_angle = ckps.start_angle; // those same 66 (  66)
-   ckps.advance_angle = ckps.advance_angle_buffered; //advance angle with all the adjustments (say, 15)(    (, 15))
+   //latch stroke command published by the main loop, all its values belong to the same pass
+   {
+    ckps_stroke_cmd_t* p_cmd = &stroke_cmd[stroke_cmd_idx];
+    ckps.advance_angle = p_cmd->advance_angle; //advance angle with all the adjustments (say, 15)(    (, 15))
+#ifdef FUEL_INJECT
+    inject_set_inj_time(p_cmd->inj_time);
+#endif
+   }
    knock_start_settings_latching();//start the process of downloading the settings into the HIP9011 (     HIP)
    adc_begin_measure(_AB(ckps.stroke_period, 1) < 4);//start the process of measuring analog input values (     )
 #ifdef STROBOSCOPE
@@ -769,11 +801,11 @@ static void process_ckps_cogs(void)
   {
    //before starting the ignition it is left to count less than 2 teeth. It is necessary to prepare the compare module
    //(      2-x .    )
-   //TODO: replace heavy division by multiplication with magic number. This will reduce up to 40uS !
-   if (ckps.period_curr < 128)
-    OCR1A = GetICR() + ((diff * (ckps.period_curr)) / ckps.degrees_per_cog) - COMPA_VECT_DELAY;
-   else
-    OCR1A = GetICR() + (((uint32_t)diff * (ckps.period_curr)) / ckps.degrees_per_cog) - COMPA_VECT_DELAY;
+   //Time = diff * period / degrees_per_cog. Division is replaced by multiplication with precalculated reciprocal:
+   //fraction of tooth (0...2, * 2^COG_FRC_SHIFT) is calculated first, then it is multiplied by the inter-tooth period.
+   //Product is rounded, because truncated reciprocal and fraction both make time shorter.
+   uint16_t frac = (diff * ckps.cogs_per_degree) >> (COG_RCP_SHIFT - COG_FRC_SHIFT);
+   OCR1A = GetICR() + (((uint32_t)ckps.period_curr * frac + (1UL << (COG_FRC_SHIFT - 1))) >> COG_FRC_SHIFT) - COMPA_VECT_DELAY;
    TIFR1 = _BV(OCF1A);
    TIMSK1|= _BV(OCIE1A);      // enable Compare A interrupt ( )
    CLEARBIT(flags, F_NTSCHA); // For avoiding to enter into setup mode (       )
@@ -799,6 +831,7 @@ static void process_ckps_cogs(void)
  */
 ISR(TIMER1_CAPT_vect)
 {
+ ISRPROF_BEGIN();
  force_pending_spark();
 
  ckps.period_curr = GetICR() - ckps.icr_prev;
@@ -811,6 +844,7 @@ ISR(TIMER1_CAPT_vect)
  {
   if (sync_at_startup())
    goto sync_enter;
+  ISRPROF_END(ISRPROF_CKPS);
   return;
  }
 
@@ -854,6 +888,7 @@ sync_enter:
  ckps.period_prev = ckps.period_curr;
 
  force_pending_spark();
+ ISRPROF_END(ISRPROF_CKPS);
 }
 
 /**Purpose of this interrupt handler is to supplement timer up to 16 bits and call procedure
@@ -862,6 +897,7 @@ sync_enter:
  *      16-  ). */
 ISR(TIMER0_COMPA_vect)
 {
+ ISRPROF_BEGIN();
  if (TCNT0_H!=0)  //Did high byte exhaust (   ) ?
  {
   TCNT0 = 0;
@@ -883,6 +919,7 @@ ISR(TIMER0_COMPA_vect)
   process_ckps_cogs();
   ++ckps.cog360;
  }
+ ISRPROF_END(ISRPROF_T0COMPA);
 }
 
 /** Timer 1 overflow interrupt.
@@ -40,8 +40,10 @@
 #include "port/port.h"
 #include "bitmask.h"
 #include "ckps.h"
+#include "injector.h"   //inject_set_inj_time()
 #include "ioconfig.h"
 #include "magnitude.h"
+#include "profiler.h"
 #include "tables.h"     //fnptr_t
 
 #include "knock.h"
@@ -119,6 +121,11 @@ typedef struct
 
 hallstate_t hall;                     //!< instance of state variables
 
+/**Double buffer of stroke commands. Main loop fills buffer which is not published, ISR latches
+ * published one at the beginning of each stroke (see ckps_get_stroke_cmd(), ckps_publish_stroke_cmd()) */
+ckps_stroke_cmd_t stroke_cmd[2];
+volatile uint8_t stroke_cmd_idx = 0;     //!< index of published stroke command
+
 /** Arrange flags in the free I/O register
  *  note: may be not effective on other MCUs or even case bugs! Be aware.
  */
@@ -195,12 +202,14 @@ void ckps_init_state(void)
  _END_ATOMIC_BLOCK();
 }
 
-void ckps_set_advance_angle(int16_t angle)
+ckps_stroke_cmd_t* ckps_get_stroke_cmd(void)
 {
- int16_t aad = (hall.shutter_wnd_width - angle);
- _BEGIN_ATOMIC_BLOCK();
- hall.advance_angle = aad;
- _END_ATOMIC_BLOCK();
+ return &stroke_cmd[stroke_cmd_idx ^ 1];
+}
+
+void ckps_publish_stroke_cmd(void)
+{
+ stroke_cmd_idx^= 1; //single byte write, so atomic block is not needed
 }
 
 void ckps_init_ports(void)
@@ -274,13 +283,6 @@ void ckps_set_ignition_cogs(uint8_t cogs)
 {
  //not supported by Hall sensor
 }
-#else
-void ckps_set_acc_time(uint16_t i_acc_time)
-{
- _BEGIN_ATOMIC_BLOCK();
- hall.cr_acc_time = i_acc_time;
- _END_ATOMIC_BLOCK();
-}
 #endif
 
 uint8_t ckps_is_error(void)
@@ -361,6 +363,11 @@ void ckps_set_knock_window(int16_t begin, int16_t end)
  _END_ATOMIC_BLOCK();
 }
 
+void ckps_set_map_window(int16_t begin, int16_t width)
+{
+ //not supported by Hall sensor
+}
+
 void ckps_enable_ignition(uint8_t i_cutoff)
 {
  WRITEBIT(flags, F_IGNIEN, i_cutoff); //enable/disable ignition
@@ -384,7 +391,7 @@ void ckps_set_cogs_num(uint8_t norm_num, uint8_t miss_num)
 }
 
 #ifdef FUEL_INJECT
-void ckps_set_inj_timing(int16_t phase)
+void ckps_set_inj_timing(int16_t phase, uint8_t pulse_end)
 {
  //not supported in this implementation
 }
@@ -567,6 +574,18 @@ sync_enter:
  SETBIT(flags, F_STROKE); //set the stroke-synchronization event
  hall.measure_start_value = tmr;
 
+ //latch stroke command published by the main loop, all its values belong to the same pass
+ {
+  ckps_stroke_cmd_t* p_cmd = &stroke_cmd[stroke_cmd_idx];
+  hall.advance_angle = hall.shutter_wnd_width - p_cmd->advance_angle;
+#ifdef DWELL_CONTROL
+  hall.cr_acc_time = p_cmd->acc_time;
+#endif
+#ifdef FUEL_INJECT
+  inject_set_inj_time(p_cmd->inj_time);
+#endif
+ }
+
  uint16_t delay;
 #ifdef STROBOSCOPE
  hall.strobe = 1; //strobe!
@@ -619,8 +638,10 @@ sync_skip:
 /**Input capture interrupt of timer 1 */
 ISR(TIMER1_CAPT_vect)
 {
+ ISRPROF_BEGIN();
  ProcessCogEdge(ICR1);
  SETBIT(flags, F_HALLEV); //set event flag
+ ISRPROF_END(ISRPROF_CKPS);
 }
 
 /**INT1 handler function (Interrupt from a Hall sensor (external)).
@@ -647,6 +668,7 @@ void ProcessInterrupt0(void)
  */
 ISR(TIMER0_COMPA_vect)
 {
+ ISRPROF_BEGIN();
  if (TCNT0_H!=0)  //Did high byte exhaust ?
  {
   TCNT0 = 0;
@@ -681,6 +703,7 @@ ISR(TIMER0_COMPA_vect)
    hall.knkwnd_mode = 0;
   }
  }
+ ISRPROF_END(ISRPROF_T0COMPA);
 }
 
 /** Timer 1 overflow interrupt.
@@ -71,6 +71,20 @@
  #define COPT_DEBUG_VARIABLES 0
 #endif
 
+/** Profiling of interrupt handlers (execution time of ISRs is measured and can be read remotely) */
+#ifdef ISR_PROFILING
+ #define COPT_ISR_PROFILING 1
+#else
+ #define COPT_ISR_PROFILING 0
+#endif
+
+/** Profiling of the main loop (execution time of loop's stages is measured and can be read remotely) */
+#ifdef LOOP_PROFILING
+ #define COPT_LOOP_PROFILING 1
+#else
+ #define COPT_LOOP_PROFILING 0
+#endif
+
 /** Use of phase sensor */
 #ifdef PHASE_SENSOR
  #define COPT_PHASE_SENSOR 1
@@ -28,63 +28,68 @@
 #include "port/port.h"
 #include "crc16.h"
 
-#define      P_16   0xA001     //!< polynomial
+/**Lookup table for CRC16 (polynomial 0xA001, reflected), processes 4 bits at once.
+ *   32   512   ,     4    */
+PGM_DECLARE(uint16_t crc16_tab[16]) =
+{
+ 0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+ 0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+/**Lookup table for CRC8 (polynomial 0x8C, reflected, Dallas/Maxim 1-Wire), processes 4 bits at once */
+PGM_DECLARE(uint8_t crc8_tab[16]) =
+{
+ 0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
+ 0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74
+};
+
+/**Adds one byte to CRC16, two table lookups (by low and high nibbles) */
+#define CRC16_BYTE(crc, data) do { \
+ (crc) ^= (data); \
+ (crc) = ((crc) >> 4) ^ PGM_GET_WORD(&crc16_tab[(crc) & 0x0F]); \
+ (crc) = ((crc) >> 4) ^ PGM_GET_WORD(&crc16_tab[(crc) & 0x0F]); \
+ } while(0)
 
 //variant for RAM
-uint16_t crc16( uint8_t *buf, uint16_t num )
+uint16_t crc16(uint8_t *buf, uint16_t num)
 {
- uint16_t i;
- uint16_t crc = 0xffff;
+ return crc16_update_buf(buf, num, 0xFFFF);
+}
 
- while ( num-- )
+uint16_t crc16_update_buf(uint8_t *buf, uint16_t num, uint16_t crc)
+{
+ while(num--)
  {
-  crc ^= *buf++;
-  i = 8;
-  do
-  {
-   if ( crc & 1 )
-    crc = ( crc >> 1 ) ^ P_16;
-   else
-    crc >>= 1;
-  } while ( --i );
+  CRC16_BYTE(crc, *buf++);
  }
- return( crc );
+ return crc;
 }
 
 //variant for FLASH
-uint16_t crc16f(uint8_t _PGM *buf, uint16_t num )
+uint16_t crc16f(uint8_t _PGM *buf, uint16_t num)
 {
- uint16_t i;
- uint16_t crc = 0xffff;
+ return crc16f_update_buf(buf, num, 0xFFFF);
+}
 
- while ( num-- )
+uint16_t crc16f_update_buf(uint8_t _PGM *buf, uint16_t num, uint16_t crc)
+{
+ while(num--)
  {
-  crc ^= PGM_GET_BYTE(buf++);
-  i = 8;
-  do
-  {
-   if ( crc & 1 )
-    crc = ( crc >> 1 ) ^ P_16;
-   else
-    crc >>= 1;
-  } while ( --i );
+  CRC16_BYTE(crc, PGM_GET_BYTE(buf++));
  }
+ return crc;
+}
 
- return( crc );
+uint16_t crc16_update(uint8_t data, uint16_t crc)
+{
+ CRC16_BYTE(crc, data);
+ return crc;
 }
 
 uint8_t update_crc8(uint8_t data, uint8_t crc)
 {
- uint8_t i = 8;
- do
- {
-  if ((crc ^ data) & 0x01)
-   crc = ((crc ^ 0x18) >> 1) | 0x80;
-  else
-   crc >>= 1;
-  data >>= 1;
- }
- while( --i );
-
+ crc ^= data;
+ crc = (crc >> 4) ^ PGM_GET_BYTE(&crc8_tab[crc & 0x0F]);
+ crc = (crc >> 4) ^ PGM_GET_BYTE(&crc8_tab[crc & 0x0F]);
  return crc;
 }
@@ -23,6 +23,7 @@
  * \author Alexey A. Shabelnikov
  * CRC16 related functions.
  * Functions for calculate CRC16 of data in RAM and in the ROM
+ * (table-driven, tables are stored in the ROM)
  */
 
 #ifndef _CRC16_H_
@@ -45,6 +46,31 @@ uint16_t crc16(uint8_t *buf, uint16_t num);
  */
 uint16_t crc16f(uint8_t _PGM *buf, uint16_t num);
 
+/** Adds given block of data in RAM to CRC16. Allows to calculate CRC of data by parts
+ * (crc16(buf, num) == crc16_update_buf(buf, num, 0xFFFF))
+ * \param buf pointer to block of data (RAM)
+ * \param num size of block to process in bytes
+ * \param crc Previous value of CRC (0xFFFF for the first part)
+ * \return updated CRC16
+ */
+uint16_t crc16_update_buf(uint8_t *buf, uint16_t num, uint16_t crc);
+
+/** Adds given block of data in ROM to CRC16. Allows to calculate CRC of data by parts
+ * (crc16f(buf, num) == crc16f_update_buf(buf, num, 0xFFFF))
+ * \param buf pointer to block of data (ROM)
+ * \param num size of block to process in bytes
+ * \param crc Previous value of CRC (0xFFFF for the first part)
+ * \return updated CRC16
+ */
+uint16_t crc16f_update_buf(uint8_t _PGM *buf, uint16_t num, uint16_t crc);
+
+/** Updates CRC16 with given byte (the same algorithm as in crc16()). Initial value of CRC must be 0xFFFF
+ * \param data Byte which will be added to CRC
+ * \param crc Previous value of CRC
+ * \return updated CRC16
+ */
+uint16_t crc16_update(uint8_t data, uint16_t crc);
+
 /** Calculates CRC8 for given byte using given seed (previous CRC value)
  * The polynomial is X8 + X5 + X4 + 1 (1-Wire bus)
  * \param data Byte which CRC will be calculated
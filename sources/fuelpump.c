@@ -60,7 +60,7 @@ void fuelpump_init_ports(void)
 void fuelpump_init(void)
 {
  TURN_ON_ELPUMP(1); //turn on
- s_timer16_set(fuel_pump_time_counter, FP_TURNOFF_TIMEOUT_STRT);
+ s_timer_set(fuel_pump_time_counter, FP_TURNOFF_TIMEOUT_STRT);
  fpstate.state = 0;
 }
 
@@ -86,7 +86,7 @@ void fuelpump_control(struct ecudata_t* d)
  {
   case 0: //pump is turned on
    //Turn off pump if timer is expired or gas valve is turned on
-   if (gas_v_logic(d) || s_timer16_is_action(fuel_pump_time_counter))
+   if (gas_v_logic(d) || s_timer_is_action(fuel_pump_time_counter))
    {
     TURN_ON_ELPUMP(0); //turn off
     fpstate.state = 1;
@@ -94,7 +94,7 @@ void fuelpump_control(struct ecudata_t* d)
 
    //reset timer periodically if engine is still running
    if (d->sens.frequen > 0)
-    s_timer16_set(fuel_pump_time_counter, FP_TURNOFF_TIMEOUT_STOP);
+    s_timer_set(fuel_pump_time_counter, FP_TURNOFF_TIMEOUT_STOP);
 
    break;
 
@@ -103,7 +103,7 @@ void fuelpump_control(struct ecudata_t* d)
    if (!gas_v_logic(d) && d->sens.frequen > 0)
    {
     TURN_ON_ELPUMP(1); //turn on
-    s_timer16_set(fuel_pump_time_counter, FP_TURNOFF_TIMEOUT_STOP);
+    s_timer_set(fuel_pump_time_counter, FP_TURNOFF_TIMEOUT_STOP);
     fpstate.state = 0;
    }
 
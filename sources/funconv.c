@@ -40,6 +40,28 @@
  #error "You can not use FUEL_INJECT option without AIRTEMP_SENS"
 #endif
 
+//Interpolation nodes are calculated once for all lookup tables (see calc_operating_point()), so axes must be the same
+#if (F_WRK_POINTS_F != RPM_GRID_SIZE) || (F_IDL_POINTS != RPM_GRID_SIZE) || (INJ_VE_POINTS_F != RPM_GRID_SIZE) || (INJ_VE_POINTS_L != LOAD_GRID_SIZE) || (F_WRK_POINTS_L != LOAD_GRID_SIZE)
+ #error "Sizes of RPM and MAP axes must be the same in all lookup tables"
+#endif
+
+oppoint_t opp;
+
+/**Reciprocals of interpolation areas' sizes used by calc_operating_point(). They are recalculated only when
+ * RPM (load) moves to another area or when MAP axis parameters are changed */
+static struct
+{
+ int8_t   f;                          //!< index of RPM area for which rpm_rcp was calculated
+ uint32_t rpm_rcp;                    //!< reciprocal of rpm_grid_sizes[f]
+ int16_t  upper_pressure;             //!< map_upper_pressure for which gradient was calculated
+ int16_t  lower_pressure;             //!< map_lower_pressure for which gradient was calculated
+ int16_t  gradient;                   //!< size of interpolation area on MAP axis
+ uint32_t map_rcp;                    //!< reciprocal of gradient
+ int8_t   g;                          //!< index of load grid's area for which load_rcp was calculated
+ uint32_t load_rcp;                   //!< reciprocal of load_grid_sizes[g]
+ uint8_t  use_grid;                   //!< 1 - load grid is used, 0 - load axis is linear (see operating_point_init())
+}oprcp = {-1, 0, 0, 0, 1, INTERP_RCP(1), -1, 0, 0};
+
 //For use with fn_dat pointer, because it can point either to FLASH or RAM
 #ifdef REALTIME_TABLES
  #define secu3_offsetof(type,member)   ((size_t)(&((type *)0)->member))
@@ -70,6 +92,38 @@ int16_t bilinear_interpolation(int16_t x, int16_t y, int16_t a1, int16_t a2, int
  return (a14 + ((((int32_t)(a23 - a14)) * (y - y_s)) / y_l));
 }
 
+/** Multiplies value by fraction of interval, rounds result toward zero like division does
+ * \param v value
+ * \param f fraction (0...1 * 2^INTERP_FRAC_BITS)
+ */
+static int16_t mul_fraction(int16_t v, uint16_t f)
+{
+ int32_t r = (int32_t)v * f;
+ return (r < 0) ? -((-r) >> INTERP_FRAC_BITS) : (r >> INTERP_FRAC_BITS);
+}
+
+uint16_t interp_fraction(int16_t d, int16_t l, uint32_t rcp)
+{
+ if (d <= 0)
+  return 0;
+ if (d > l)
+  d = l;
+ return (((uint32_t)d) * rcp) >> (INTERP_RCP_BITS - INTERP_FRAC_BITS);
+}
+
+int16_t bilinear_interpolation_fr(int16_t a1, int16_t a2, int16_t a3, int16_t a4, uint16_t fx, uint16_t fy)
+{
+ int16_t a23,a14;
+ a23 = (a2 * 16) + mul_fraction((a3 - a2) * 16, fx);
+ a14 = (a1 * 16) + mul_fraction((a4 - a1) * 16, fx);
+ return a14 + mul_fraction(a23 - a14, fy);
+}
+
+int16_t simple_interpolation_fr(int16_t a1, int16_t a2, uint16_t fx, uint8_t m)
+{
+ return (a1 * m) + mul_fraction((a2 - a1) * m, fx);
+}
+
 //   
 // x -    
 // a1,a2 -     
@@ -82,22 +136,114 @@ int16_t simple_interpolation(int16_t x, int16_t a1, int16_t a2, int16_t x_s, int
  return ((a1 * m) + (((int32_t)(a2 - a1) * m) * (x - x_s)) / x_l);
 }
 
-//        
-//        * 32. 2 * 16 = 32.
-int16_t idling_function(struct ecudata_t* d)
+/** Checks whether load grid is filled and valid. All sizes of cells must be positive, otherwise reciprocal of
+ * the size can not be calculated, and points must be in ascending order, because calc_load_grid_point() relies on it
+ * \return 1 - load grid can be used, 0 - linear load axis must be used
+ */
+static uint8_t load_grid_valid(void)
+{
+ uint8_t g;
+ for(g = 0; g < LOAD_GRID_SIZE-1; ++g)
+  if ((int16_t)PGM_GET_WORD(&fw_data.exdata.load_grid_sizes[g]) <= 0 ||
+      (int16_t)PGM_GET_WORD(&fw_data.exdata.load_grid_points[g+1]) <= (int16_t)PGM_GET_WORD(&fw_data.exdata.load_grid_points[g]))
+   return 0;
+ return 1;
+}
+
+void operating_point_init(void)
 {
- int8_t i;
- int16_t rpm = d->sens.inst_frq;
+ oprcp.use_grid = load_grid_valid();
+ oprcp.f = -1, oprcp.g = -1;          //reciprocals will be recalculated
+}
+
+/** Calculates interpolation nodes on the load axis using load grid (non-linear axis)
+ * \param d pointer to ECU data structure
+ */
+static void calc_load_grid_point(struct ecudata_t* d)
+{
+ int8_t g;
+ int16_t load = d->sens.map;
+
+ for(g = LOAD_GRID_SIZE-2; g >= 0; g--)
+  if (load >= PGM_GET_WORD(&fw_data.exdata.load_grid_points[g])) break;
+
+ if (g < 0)  {g = 0; load = PGM_GET_WORD(&fw_data.exdata.load_grid_points[0]);}
+ if (load > PGM_GET_WORD(&fw_data.exdata.load_grid_points[LOAD_GRID_SIZE-1])) load = PGM_GET_WORD(&fw_data.exdata.load_grid_points[LOAD_GRID_SIZE-1]);
+
+ if (g != oprcp.g)
+ { //load moved to another area, update reciprocal
+  oprcp.load_rcp = INTERP_RCP(PGM_GET_WORD(&fw_data.exdata.load_grid_sizes[g]));
+  oprcp.g = g;
+ }
+
+ //rows of tables go from the highest load to the lowest, so upper point of the area corresponds to row l
+ opp.l = (LOAD_GRID_SIZE-2) - g;
+ opp.lp1 = opp.l + 1;
+ opp.map_frac = interp_fraction(PGM_GET_WORD(&fw_data.exdata.load_grid_points[g+1]) - load,
+                PGM_GET_WORD(&fw_data.exdata.load_grid_sizes[g]), oprcp.load_rcp);
+}
+
+void calc_operating_point(struct ecudata_t* d)
+{
+ int8_t f, l;
+ int16_t rpm = d->sens.inst_frq, discharge, rpm_s;
 
  //  ,       
- for(i = F_IDL_POINTS-2; i >= 0; i--)
-  if (d->sens.inst_frq >= PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[i])) break;
+ for(f = RPM_GRID_SIZE-2; f >= 0; f--)
+  if (rpm >= PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f])) break;
+
+ //   rpm_grid_points[0]   
+ if (f < 0)  {f = 0; rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[0]);}
+ if (rpm > PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[RPM_GRID_SIZE-1])) rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[RPM_GRID_SIZE-1]);
+
+ rpm_s = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f]);
+ if (f != oprcp.f)
+ { //RPM moved to another area, update reciprocal
+  oprcp.rpm_rcp = INTERP_RCP(PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[f]));
+  oprcp.f = f;
+ }
+ opp.f = f;
+ opp.fp1 = f + 1;
+ opp.rpm_frac = interp_fraction(rpm - rpm_s, PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[f]), oprcp.rpm_rcp);
+
+ //use load grid if it is filled, otherwise load axis is linear
+ if (oprcp.use_grid)
+ {
+  calc_load_grid_point(d);
+  return;
+ }
 
- if (i < 0)  {i = 0; rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[0]);}
- if (rpm > PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[F_IDL_POINTS-1])) rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[F_IDL_POINTS-1]);
+ discharge = (d->param.map_upper_pressure - d->sens.map);
+ if (discharge < 0) discharge = 0;
+
+ if (d->param.map_upper_pressure != oprcp.upper_pressure || d->param.map_lower_pressure != oprcp.lower_pressure)
+ { //parameters of MAP axis were changed
+  //map_upper_pressure - value of the upper pressure
+  //map_lower_pressure - value of the lower pressure
+  int16_t gradient = (d->param.map_upper_pressure - d->param.map_lower_pressure) / (F_WRK_POINTS_L-1); //divide by number of points on the MAP axis - 1
+  if (gradient < 1)
+   gradient = 1;  //exclude division by zero and negative value in case when upper pressure < lower pressure
+  oprcp.gradient = gradient;
+  oprcp.map_rcp = INTERP_RCP(gradient);
+  oprcp.upper_pressure = d->param.map_upper_pressure;
+  oprcp.lower_pressure = d->param.map_lower_pressure;
+ }
+ l = (discharge / oprcp.gradient);
+
+ if (l >= (F_WRK_POINTS_L - 1))
+  opp.lp1 = l = F_WRK_POINTS_L - 1;
+ else
+  opp.lp1 = l + 1;
+
+ opp.l = l;
+ opp.map_frac = interp_fraction(discharge - (oprcp.gradient * l), oprcp.gradient, oprcp.map_rcp);
+}
 
- return simple_interpolation(rpm, _GB(f_idl[i]), _GB(f_idl[i+1]),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[i]), PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[i]), 16);
+//        
+//        * 32. 2 * 16 = 32.
+int16_t idling_function(struct ecudata_t* d)
+{
+ return simple_interpolation_fr(_GB(f_idl[opp.f]), _GB(f_idl[opp.fp1]), opp.rpm_frac, 16);
 }
 
 
@@ -121,48 +267,19 @@ int16_t start_function(struct ecudata_t* d)
 //        * 32, 2 * 16 = 32.
 int16_t work_function(struct ecudata_t* d, uint8_t i_update_airflow_only)
 {
- int16_t  gradient, discharge, rpm = d->sens.inst_frq, l;
- int8_t f, fp1, lp1;
-
- discharge = (d->param.map_upper_pressure - d->sens.map);
- if (discharge < 0) discharge = 0;
-
- //map_upper_pressure - value of the upper pressure
- //map_lower_pressure - value of the lower pressure
- gradient = (d->param.map_upper_pressure - d->param.map_lower_pressure) / (F_WRK_POINTS_L-1); //divide by number of points on the MAP axis - 1
- if (gradient < 1)
-  gradient = 1;  //exclude division by zero and negative value in case when upper pressure < lower pressure
- l = (discharge / gradient);
-
- if (l >= (F_WRK_POINTS_L - 1))
-  lp1 = l = F_WRK_POINTS_L - 1;
- else
-  lp1 = l + 1;
-
  //update air flow variable
- d->airflow = 16 - l;
+ d->airflow = 16 - opp.l;
 
  if (i_update_airflow_only)
   return 0; //          
 
- //  ,       
- for(f = F_WRK_POINTS_F-2; f >= 0; f--)
-  if (rpm >= PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f])) break;
-
- //    rpm_grid_points[0]   
- if (f < 0)  {f = 0; rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[0]);}
- if (rpm > PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[F_WRK_POINTS_F-1])) rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[F_WRK_POINTS_F-1]);
- fp1 = f + 1;
-
- return bilinear_interpolation(rpm, discharge,
-        _GB(f_wrk[l][f]),
-        _GB(f_wrk[lp1][f]),
-        _GB(f_wrk[lp1][fp1]),
-        _GB(f_wrk[l][fp1]),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f]),
-        (gradient * l),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[f]),
-        gradient);
+ return bilinear_interpolation_fr(
+        _GB(f_wrk[opp.l][opp.f]),
+        _GB(f_wrk[opp.lp1][opp.f]),
+        _GB(f_wrk[opp.lp1][opp.fp1]),
+        _GB(f_wrk[opp.l][opp.fp1]),
+        opp.rpm_frac,
+        opp.map_frac);
 }
 
 //     (. )  
@@ -209,7 +326,7 @@ void idling_regulator_init(void)
 
 //  (  )       
 //        * 32.
-int16_t idling_pregulator(struct ecudata_t* d, volatile s_timer8_t* io_timer)
+int16_t idling_pregulator(struct ecudata_t* d, s_timer_t* io_timer)
 {
  int16_t error,factor;
  // ""         
@@ -515,29 +632,7 @@ int16_t ats_lookup(uint16_t adcvalue)
 #ifdef FUEL_INJECT
 uint16_t inj_base_pw(struct ecudata_t* d)
 {
- int16_t  gradient, discharge, rpm = d->sens.inst_frq, l, afr;
- int8_t f, fp1, lp1;
-
- //calculate lookup table indexes. VE and AFR tables have same size
- discharge = (d->param.map_upper_pressure - d->sens.map);
- if (discharge < 0) discharge = 0;
-
- gradient = (d->param.map_upper_pressure - d->param.map_lower_pressure) / (INJ_VE_POINTS_L-1);
- if (gradient < 1)
-  gradient = 1;
- l = (discharge / gradient);
-
- if (l >= (INJ_VE_POINTS_F - 1))
-  lp1 = l = INJ_VE_POINTS_F - 1;
- else
-  lp1 = l + 1;
-
- for(f = 14; f >= 0; f--)
-  if (rpm >= PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f])) break;
-
- if (f < 0)  {f = 0; rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[0]);}
- if (rpm > PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[INJ_VE_POINTS_F-1])) rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[INJ_VE_POINTS_F-1]);
-  fp1 = f + 1;
+ int16_t afr;
 
  //Calculate basic pulse width. Calculations are based on the ideal gas law and precalulated constant
  //All Ideal gas law arguments except MAP and air temperature were drove in to the constant, this dramatically increases performance
@@ -554,27 +649,23 @@ uint16_t inj_base_pw(struct ecudata_t* d)
  pw32>>=(2-nsht);     //after this shift pw32 value is basic pulse width * 4
 
  //apply VE table, bilinear_interpolation() returns value * 16, we additionally divide it by 4 to avoid oveflow
- pw32*= bilinear_interpolation(rpm, discharge,
-        _GBU(inj_ve[l][f]),   //values in table are unsigned
-        _GBU(inj_ve[lp1][f]),
-        _GBU(inj_ve[lp1][fp1]),
-        _GBU(inj_ve[l][fp1]),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f]),
-        (gradient * l),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[f]),
-        gradient) >> 2;
+ pw32*= bilinear_interpolation_fr(
+        _GBU(inj_ve[opp.l][opp.f]),   //values in table are unsigned
+        _GBU(inj_ve[opp.lp1][opp.f]),
+        _GBU(inj_ve[opp.lp1][opp.fp1]),
+        _GBU(inj_ve[opp.l][opp.fp1]),
+        opp.rpm_frac,
+        opp.map_frac) >> 2;
  pw32>>=(7+4);
 
  //apply AFR table
- afr = bilinear_interpolation(rpm, discharge,
-        _GBU(inj_afr[l][f]),  //values in table are unsigned
-        _GBU(inj_afr[lp1][f]),
-        _GBU(inj_afr[lp1][fp1]),
-        _GBU(inj_afr[l][fp1]),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f]),
-        (gradient * l),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[f]),
-        gradient) >> 2;
+ afr = bilinear_interpolation_fr(
+        _GBU(inj_afr[opp.l][opp.f]),  //values in table are unsigned
+        _GBU(inj_afr[opp.lp1][opp.f]),
+        _GBU(inj_afr[opp.lp1][opp.fp1]),
+        _GBU(inj_afr[opp.l][opp.fp1]),
+        opp.rpm_frac,
+        opp.map_frac) >> 2;
  pw32=(pw32 * afr)>>(11+2);
  d->corr.afr=afr>>2;          //update value of AFR
 
@@ -695,42 +786,13 @@ uint8_t inj_iac_pos_lookup(struct ecudata_t* d, int16_t* p_prev_temp, uint8_t mo
 
 int16_t inj_timing_lookup(struct ecudata_t* d)
 {
- int16_t  gradient, discharge, rpm = d->sens.inst_frq, l;
- int8_t f, fp1, lp1;
-
- discharge = (d->param.map_upper_pressure - d->sens.map);
- if (discharge < 0) discharge = 0;
-
- //map_upper_pressure - value of the upper pressure
- //map_lower_pressure - value of the lower pressure
- gradient = (d->param.map_upper_pressure - d->param.map_lower_pressure) / (INJ_VE_POINTS_L-1); //divide by number of points on the MAP axis - 1
- if (gradient < 1)
-  gradient = 1;  //exclude division by zero and negative value in case when upper pressure < lower pressure
- l = (discharge / gradient);
-
- if (l >= (INJ_VE_POINTS_L - 1))
-  lp1 = l = INJ_VE_POINTS_L - 1;
- else
-  lp1 = l + 1;
-
- //  ,       
- for(f = INJ_VE_POINTS_F-2; f >= 0; f--)
-  if (rpm >= PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f])) break;
-
- //    rpm_grid_points[0]   
- if (f < 0)  {f = 0; rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[0]);}
- if (rpm > PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[INJ_VE_POINTS_F-1])) rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[INJ_VE_POINTS_F-1]);
- fp1 = f + 1;
-
- return bilinear_interpolation(rpm, discharge,
-        _GBU(inj_timing[l][f]),
-        _GBU(inj_timing[lp1][f]),
-        _GBU(inj_timing[lp1][fp1]),
-        _GBU(inj_timing[l][fp1]),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f]),
-        (gradient * l),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[f]),
-        gradient) * 3 * 2;
+ return bilinear_interpolation_fr(
+        _GBU(inj_timing[opp.l][opp.f]),
+        _GBU(inj_timing[opp.lp1][opp.f]),
+        _GBU(inj_timing[opp.lp1][opp.fp1]),
+        _GBU(inj_timing[opp.l][opp.fp1]),
+        opp.rpm_frac,
+        opp.map_frac) * 3 * 2;
 }
 
 #endif //FUEL_INJECT
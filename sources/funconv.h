@@ -60,8 +60,72 @@ int16_t simple_interpolation(int16_t x,int16_t a1,int16_t a2,int16_t x_s,int16_t
  */
 int16_t bilinear_interpolation(int16_t x,int16_t y,int16_t a1,int16_t a2,int16_t a3,int16_t a4,int16_t x_s,int16_t y_s,int16_t x_l,int16_t y_l);
 
+/**Number of bits in the fraction of interpolation interval (see interp_fraction()) */
+#define INTERP_FRAC_BITS 15
+
+/**Number of bits in the reciprocal of interval's length (see INTERP_RCP) */
+#define INTERP_RCP_BITS  28
+
+/**Calculates reciprocal of interval's length (rounded up), can be used for constants
+ * \param l length of interval (> 0)
+ */
+#define INTERP_RCP(l) ((uint32_t)(((1UL << INTERP_RCP_BITS) + (l) - 1) / (l)))
+
+/** Calculates position of argument inside interpolation interval without division
+ * \param d distance from the beginning of interval (restricted to 0...l)
+ * \param l length of interval
+ * \param rcp reciprocal of interval's length, see INTERP_RCP
+ * \return fraction of interval (0...1 * 2^INTERP_FRAC_BITS)
+ */
+uint16_t interp_fraction(int16_t d, int16_t l, uint32_t rcp);
+
+/** f(x) liniar interpolation, version of simple_interpolation() without division
+ * \param a1 function value at the beginning of interval
+ * \param a2 function value at the end of interval
+ * \param fx fraction of interval in x (see interp_fraction())
+ * \param m function multiplier
+ * \return interpolated value of function * m
+ */
+int16_t simple_interpolation_fr(int16_t a1, int16_t a2, uint16_t fx, uint8_t m);
+
+/** f(x,y) liniar interpolation, version of bilinear_interpolation() without division
+ * \param a1 function value at the beginning of interval (1 corner)
+ * \param a2 function value at the beginning of interval (2 corner)
+ * \param a3 function value at the beginning of interval (3 corner)
+ * \param a4 function value at the beginning of interval (4 corner)
+ * \param fx fraction of interval in x (see interp_fraction())
+ * \param fy fraction of interval in y (see interp_fraction())
+ * \return interpolated value of function * 16
+ */
+int16_t bilinear_interpolation_fr(int16_t a1, int16_t a2, int16_t a3, int16_t a4, uint16_t fx, uint16_t fy);
+
 struct ecudata_t;
 
+/**Describes operating point of engine on the RPM and MAP axes of lookup tables: interpolation nodes
+ * and their arguments. It is calculated once per main loop pass and used by all 2D lookup functions */
+typedef struct
+{
+ uint16_t rpm_frac;                   //!< position of RPM inside interpolation area (see interp_fraction())
+ uint16_t map_frac;                   //!< position of MAP inside interpolation area (see interp_fraction())
+ int8_t  f;                           //!< index of node on RPM axis
+ int8_t  fp1;                         //!< f + 1
+ int8_t  l;                           //!< index of node on MAP axis
+ int8_t  lp1;                         //!< l + 1 (restricted)
+}oppoint_t;
+
+extern oppoint_t opp;                 //!< current operating point, see calc_operating_point()
+
+/** Calculates interpolation nodes for current RPM and MAP. Must be called after new values of RPM and MAP
+ * become available and before calling of lookup functions (work_function(), idling_function(), inj_base_pw() etc)
+ * \param d pointer to ECU data structure
+ */
+void calc_operating_point(struct ecudata_t* d);
+
+/** Checks load grid (it does not change at runtime) and resets cached reciprocals. Must be called before first
+ * call of calc_operating_point() and each time data of firmware (load grid) is changed
+ */
+void operating_point_init(void);
+
 /** Calculates advance angle from "start" map
  * \param d pointer to ECU data structure
  * \return value of advance angle * 32
@@ -101,7 +165,7 @@ void idling_regulator_init(void);
  * \param io_timer
  * \return value of advance angle * 32
  */
-int16_t idling_pregulator(struct ecudata_t* d, volatile s_timer8_t* io_timer);
+int16_t idling_pregulator(struct ecudata_t* d, s_timer_t* io_timer);
 
 /** function for restricting of advance angle alternation speed
  * \param new_advance_angle New value of advance angle (input)
@@ -37,6 +37,11 @@
 #include "magnitude.h"
 #include "pwrrelay.h"
 
+//Interpolation nodes on RPM axis are shared with other lookup tables (see calc_operating_point())
+#if GASDOSE_POS_RPM_SIZE != RPM_GRID_SIZE
+ #error "Size of RPM axis in gas dose map must be equal to RPM_GRID_SIZE"
+#endif
+
 /**Direction used to set stepper motor to the initial position */
 #define INIT_POS_DIR SM_DIR_CW
 
@@ -69,32 +74,22 @@ static gasdose_st_t gds = {0};
  */
 int16_t gdp_function(struct ecudata_t* d)
 {
- int16_t rpm = d->sens.inst_frq, tps = (TPS_MAGNITUDE(100.0) - d->sens.tps) * 16;
- int8_t t = (tps / TPS_AXIS_STEP), f, tp1, fp1;
+ int16_t tps = (TPS_MAGNITUDE(100.0) - d->sens.tps) * 16;
+ int8_t t = (tps / TPS_AXIS_STEP), tp1;
 
  if (t >= (GASDOSE_POS_TPS_SIZE - 1))
   tp1 = t = GASDOSE_POS_TPS_SIZE - 1;
  else
   tp1 = t + 1;
 
- //find interpolation points, then restrict RPM if it fall outside set range
- for(f = GASDOSE_POS_RPM_SIZE-2; f >= 0; f--)
-  if (rpm >= PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f])) break;
-
- //Gas dose map works from rpm_grid_points[0] and upper
- if (f < 0)  {f = 0; rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[0]);}
- if (rpm > PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[GASDOSE_POS_RPM_SIZE-1])) rpm = PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[GASDOSE_POS_RPM_SIZE-1]);
- fp1 = f + 1;
-
- return bilinear_interpolation(rpm, tps,  //note that tps is additionally multiplied by 16
-        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[t][f]),
-        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[tp1][f]),
-        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[tp1][fp1]),
-        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[t][fp1]),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_points[f]),
-        (TPS_AXIS_STEP*t),
-        PGM_GET_WORD(&fw_data.exdata.rpm_grid_sizes[f]),
-        TPS_AXIS_STEP) >> 4;
+ //interpolation nodes on RPM axis are taken from current operating point (see calc_operating_point())
+ return bilinear_interpolation_fr(
+        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[t][opp.f]),
+        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[tp1][opp.f]),
+        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[tp1][opp.fp1]),
+        PGM_GET_BYTE(&fw_data.exdata.gasdose_pos[t][opp.fp1]),
+        opp.rpm_frac,
+        interp_fraction(tps - (TPS_AXIS_STEP*t), TPS_AXIS_STEP, INTERP_RCP(TPS_AXIS_STEP))) >> 4;
 }
 
 /** Calculates AE value for gas doser
@@ -57,6 +57,18 @@
 /**Maximum queue size per timer channel */
 #define INJ_CH_QUEUE_SIZE 4
 
+/**Number of injector outputs */
+#define INJ_OUTPUTS_NUM 8
+
+/**Maximum injection time in full sequential mode (ticks of timer 1), keeps times of events comparable */
+#define INJ_FS_MAX_TIME 20000
+
+/**Maximum delay of injection start in full sequential mode (ticks of timer 1) */
+#define INJ_FS_MAX_DELAY 12000
+
+/**Injectors which must be closed within this time (ticks of timer 1) are closed together with the current ones */
+#define INJ_FS_MERGE_TIME 4
+
 /** Define injector state variables structure*/
 typedef struct
 {
@@ -64,6 +76,7 @@ typedef struct
  volatile uint8_t tmr2b_h;       //!< used in timer2 COMPB interrupt to perform 16-bit timing
  volatile uint8_t tmr0b_h;       //!< used in timer0 COMPB interrupt to perform 16-bit timing
  volatile uint8_t cyl_number;    //!< number of engine cylinders
+ volatile uint8_t all_outs;      //!< bit mask of outputs turned on together (central/simultaneous), see inject_set_cyl_number()
  uint8_t  num_squirts;           //!< number of squirts per cycle
  volatile uint8_t fuelcut;       //!< fuelcut flag
  volatile uint8_t prime_pulse;   //!< prime pulse flag
@@ -79,6 +92,12 @@ typedef struct
 
  volatile uint8_t active_chan;   //!< active channels
  volatile uint8_t mask_chan;     //!< for masking of channels
+
+ //See inj_fsq global variable
+ volatile uint8_t fsq_head;      //!< index of the nearest event in the ring buffer of full sequential mode
+ volatile uint8_t fsq_size;      //!< number of events in the queue of full sequential mode
+ volatile uint8_t fs_phased;     //!< flag, indicates that phase of engine cycle is known (cam sensor)
+ volatile uint8_t fsq_error;     //!< flag, set when pulse was skipped because queue of full sequential mode was full
 }inj_state_t;
 
 /**Describes injector channels*/
@@ -97,6 +116,19 @@ typedef struct
  uint8_t  chan_idx;              //!< Associated injection channel number which will be turned off
 }inj_queue_t;
 
+/**Describes event of sorted queue used in full sequential mode*/
+typedef struct
+{
+ uint16_t time;                  //!< Time of event in ticks of free running timer 1
+ uint8_t  outs;                  //!< Bit mask of injector outputs which will be turned on/off
+ uint8_t  state;                 //!< INJ_ON - open injectors, INJ_OFF - close injectors
+}inj_fsq_t;
+
+/**Size of the event queue used in full sequential mode. Each output may have closing event of the current
+ * pulse, opening and closing events of the next (delayed) pulse. This is true while delay of injection is less
+ * than period of engine cycle. Otherwise queue may become full and then pulse is skipped and error is reported */
+#define INJ_FSQ_SIZE (INJ_OUTPUTS_NUM * 3)
+
 /** Global instance of injector state variable structure*/
 inj_state_t inj;
 
@@ -109,6 +141,14 @@ inj_queue_t inj_eq1[INJ_CH_QUEUE_SIZE];
 /**Event queue for scheduling of injection outputs control (2-nd timer channel) */
 inj_queue_t inj_eq2[INJ_CH_QUEUE_SIZE];
 
+/**Event queue of full sequential mode, ring buffer sorted by time (head is the nearest event) */
+inj_fsq_t inj_fsq[INJ_FSQ_SIZE];
+
+/**Returns event of full sequential mode's queue (ring buffer)
+ * \param i Position of event in the queue (0 - head)
+ */
+#define FSQ_AT(i) inj_fsq[fsq_index(i)]
+
 /** Add event into the queue (add to head) */
 #define QUEUE_ADD(q, time, chan) \
     inj_eq##q[inj.eq_head##q].end_time = TCNT1 + (time); \
@@ -130,6 +170,26 @@ inj_queue_t inj_eq2[INJ_CH_QUEUE_SIZE];
 /** Reset specified queue */
 #define QUEUE_RESET(q)  inj.eq_tail##q = inj.eq_head##q = 0;
 
+/** Get I/O callback of injector output. This function is necessary for supporting of outputs 5-8
+ * \param index Index of output (0...7) */
+INLINE
+static fnptr_t get_callback(uint8_t index)
+{
+ return (index < 4) ? IOCFG_CB(IOP_INJ_OUT0 + index) : IOCFG_CB(IOP_INJ_OUT0 + IOP_INJ47_OFF + index);
+}
+
+/** Turn on/off specified injector outputs
+ * \param outs Bit mask of outputs
+ * \param state INJ_ON or INJ_OFF
+ */
+static void set_outputs(uint8_t outs, uint8_t state)
+{
+ uint8_t i = 0;
+ for(; outs; ++i, outs>>=1)
+  if (outs & 1)
+   ((iocfg_pfn_set)get_callback(i))(state);
+}
+
 
 /**Tune channels' I/O for semi-sequential injection mode */
 static void set_channels_ss(void)
@@ -196,6 +256,11 @@ void inject_init_state(void)
  inj.mask_chan = 0xFF;
  QUEUE_RESET(1);   //head = tail
  QUEUE_RESET(2);   //head = tail
+ inj.fsq_head = 0;
+ inj.fsq_size = 0;
+ inj.fs_phased = 0;
+ inj.fsq_error = 0;
+ inj.all_outs = 0x0F;
 }
 
 void inject_init_ports(void)
@@ -204,12 +269,17 @@ void inject_init_ports(void)
  IOCFG_INIT(IOP_INJ_OUT1, INJ_OFF);           //injector 2 is turned off
  IOCFG_INIT(IOP_INJ_OUT2, INJ_OFF);           //injector 3 is turned off
  IOCFG_INIT(IOP_INJ_OUT3, INJ_OFF);           //injector 4 is turned off
+ IOCFG_INIT(IOP_INJ_OUT4, INJ_OFF);           //injector 5 is turned off
+ IOCFG_INIT(IOP_INJ_OUT5, INJ_OFF);           //injector 6 is turned off
+ IOCFG_INIT(IOP_INJ_OUT6, INJ_OFF);           //injector 7 is turned off
+ IOCFG_INIT(IOP_INJ_OUT7, INJ_OFF);           //injector 8 is turned off
 }
 
 /** Updates squirt mask */
 static void calc_squirt_mask(void)
 {
- uint8_t sqr_cyl = 0, i = 0, cyl_inc = inj.cyl_number / inj.num_squirts;
+ //in full sequential mode each cylinder has its own squirt
+ uint8_t sqr_cyl = 0, i = 0, cyl_inc = (inj.cfg == INJCFG_FULLSEQUENTIAL) ? 1 : inj.cyl_number / inj.num_squirts;
  inj.squirt_mask = 0;
  for(; i < inj.cyl_number; ++i)
  {
@@ -227,6 +297,8 @@ void inject_set_cyl_number(uint8_t cylnum)
 {
  _BEGIN_ATOMIC_BLOCK();
  inj.cyl_number = cylnum;
+ //outputs 1-4 are always used (as before), outputs 5-8 only if there are such cylinders
+ inj.all_outs = (cylnum > 4) ? (uint8_t)((1 << cylnum) - 1) : 0x0F;
  calc_squirt_mask();                          //update squirt mask
  if (inj.cfg == INJCFG_2BANK_ALTERN)
   set_channels_2bnk();                        //2 banks, alternating
@@ -263,13 +335,178 @@ void inject_set_fuelcut(uint8_t state)
 
 void inject_set_config(uint8_t cfg)
 {
+ _BEGIN_ATOMIC_BLOCK();
  inj.cfg = cfg;
+ calc_squirt_mask();                               //mask depends on configuration
+ _END_ATOMIC_BLOCK();
  if (cfg == INJCFG_2BANK_ALTERN)
   set_channels_2bnk();                             //2 banks, alternating
  else if (cfg == INJCFG_SEMISEQUENTIAL)            //semi-sequential mode
   set_channels_ss();
 }
 
+void inject_set_phased(uint8_t phased)
+{
+ inj.fs_phased = phased;
+}
+
+uint8_t inject_is_error(void)
+{
+ return inj.fsq_error;
+}
+
+void inject_reset_error(void)
+{
+ inj.fsq_error = 0;
+}
+
+/** Calculates index of event in the ring buffer of full sequential mode
+ * \param i Position of event in the queue (0 - head)
+ * \return index in inj_fsq array
+ */
+static uint8_t fsq_index(uint8_t i)
+{
+ i+= inj.fsq_head;
+ if (i >= INJ_FSQ_SIZE)
+  i-= INJ_FSQ_SIZE;
+ return i;
+}
+
+/** Arm timer 2 channel B for the nearest event of full sequential mode.
+ * Interrupts must be disabled */
+static void fs_arm_timer(void)
+{
+ if (inj.fsq_size)
+ {
+  int16_t t = inj_fsq[inj.fsq_head].time - TCNT1;
+  uint16_t t2;
+  if (t < INJ_FS_MERGE_TIME)
+   t = INJ_FS_MERGE_TIME;                     //event is already expired
+  t2 = ((uint16_t)t) >> 1;                    //1 tick = 6.4us
+  if (0==_AB(t2, 0))                          //avoid strange bug which appears when OCR2B is set to the same value as TCNT2
+   (_AB(t2, 0))++;
+  OCR2B = TCNT2 + _AB(t2, 0);
+  inj.tmr2b_h = _AB(t2, 1);
+  SETBIT(TIMSK2, OCIE2B);
+  SETBIT(TIFR2, OCF2B);                       //reset possible pending interrupt flag
+ }
+ else
+  CLEARBIT(TIMSK2, OCIE2B);                   //disable this interrupt
+}
+
+/** Insert event into the sorted queue of full sequential mode. Queue must have free space. Search goes from
+ * the tail, because new events are usually the latest ones. Interrupts must be disabled
+ * \param now Current value of timer 1
+ * \param t Time of event relatively to now (ticks of timer 1)
+ * \param outs Bit mask of outputs
+ * \param state INJ_ON or INJ_OFF
+ */
+static void fs_insert(uint16_t now, uint16_t t, uint8_t outs, uint8_t state)
+{
+ uint8_t i = inj.fsq_size;
+ for(; i > 0; --i)
+ {
+  if ((int16_t)(FSQ_AT(i - 1).time - now) <= (int16_t)t)
+   break;
+  FSQ_AT(i) = FSQ_AT(i - 1);                  //move later event toward the tail
+ }
+ FSQ_AT(i).time = now + t;
+ FSQ_AT(i).outs = outs;
+ FSQ_AT(i).state = state;
+ ++inj.fsq_size;
+}
+
+/** Remove event from the queue of full sequential mode, later events are moved toward the head.
+ * Interrupts must be disabled
+ * \param i Position of event in the queue (0 - head)
+ */
+static void fs_remove(uint8_t i)
+{
+ for(--inj.fsq_size; i < inj.fsq_size; ++i)
+  FSQ_AT(i) = FSQ_AT(i + 1);
+}
+
+/** Start injection in full sequential mode. Each cylinder has its own injector. If phase of engine cycle is not
+ * known yet, then injectors of cylinders which are 360 apart are opened together once per cycle.
+ * Events are kept in sorted queue, so overlapping pulses are not truncated. If injector is still open when new
+ * pulse begins, then its pulse is prolonged up to the end of new one. If queue is full (see INJ_FSQ_SIZE), then
+ * pulse is skipped and error is reported.
+ * \param chan Channel number (number of cylinder in the firing order)
+ * \param delay Delay before opening of injector(s), ticks of timer 1
+ */
+static void start_inj_fs(uint8_t chan, uint16_t delay)
+{
+ uint8_t outs, i, k;
+ uint16_t now, t = inj.inj_time << 1;        //1 tick = 3.2us
+ int8_t trim = PGM_GET_BYTE(&fw_data.exdata.inj_cyl_trim[chan]);
+ if (trim)
+  t+= (int16_t)(((int32_t)t * trim) >> 8);   //apply per-cylinder trim
+ if (t > INJ_FS_MAX_TIME)
+  t = INJ_FS_MAX_TIME;
+ if (delay > INJ_FS_MAX_DELAY)
+  delay = INJ_FS_MAX_DELAY;
+
+ if (inj.fs_phased || (inj.cyl_number & 1))
+  outs = _BV(chan);
+ else
+ {
+  uint8_t half = inj.cyl_number >> 1;
+  if (chan >= half)
+   return;                                    //injector of this cylinder was opened together with its pair
+  outs = _BV(chan) | _BV(chan + half);
+ }
+
+ _BEGIN_ATOMIC_BLOCK();
+ now = TCNT1;
+ //remove pending events of these outputs which overlap with the new pulse (pulses are merged). Only outputs of
+ //events are checked, queue is changed only when pulses overlap (rarely), so this loop is short in the ISR
+ for(i = 0, k = inj.fsq_head; i < inj.fsq_size;)
+ {
+  inj_fsq_t* e = &inj_fsq[k];
+  if ((e->outs & outs) && (INJ_ON == e->state || (int16_t)(e->time - now) >= (int16_t)delay))
+  {
+   e->outs&= ~outs;
+   if (!e->outs)
+   {
+    fs_remove(i);                             //next event takes place of this one
+    continue;
+   }
+  }
+  ++i;
+  if (++k == INJ_FSQ_SIZE)
+   k = 0;
+ }
+
+ if (inj.fsq_size > (INJ_FSQ_SIZE - 2))
+  inj.fsq_error = 1;                          //no space for events of new pulse, skip it
+ else
+ {
+  if (delay < INJ_FS_MERGE_TIME)
+   set_outputs(outs, INJ_ON);                 //turn on injector(s) immediately
+  else
+   fs_insert(now, delay, outs, INJ_ON);
+  fs_insert(now, delay + t, outs, INJ_OFF);
+ }
+ fs_arm_timer();
+ _END_ATOMIC_BLOCK();
+}
+
+void inject_start_inj_delayed(uint8_t chan, uint16_t delay)
+{
+ if (inj.cfg == INJCFG_FULLSEQUENTIAL)
+ {
+  if (inj.fuelcut && CHECKBIT(inj.squirt_mask, chan))
+   start_inj_fs(chan, delay);
+ }
+ else
+  inject_start_inj(chan);                     //delay is not supported in other modes
+}
+
+uint8_t inject_is_delay_supported(void)
+{
+ return (inj.cfg == INJCFG_FULLSEQUENTIAL);
+}
+
 void inject_start_inj(uint8_t chan)
 {
  if (!inj.fuelcut)
@@ -283,14 +520,13 @@ void inject_start_inj(uint8_t chan)
    _BEGIN_ATOMIC_BLOCK();
    OCR2B = TCNT2 + _AB(inj.inj_time, 0);
    inj.tmr2b_h = _AB(inj.inj_time, 1);
-   IOCFG_SET(IOP_INJ_OUT0, INJ_ON);           //turn on injector 1
-   IOCFG_SET(IOP_INJ_OUT1, INJ_ON);           //turn on injector 2
-   IOCFG_SET(IOP_INJ_OUT2, INJ_ON);           //turn on injector 3
-   IOCFG_SET(IOP_INJ_OUT3, INJ_ON);           //turn on injector 4
+   set_outputs(inj.all_outs, INJ_ON);                 //turn on all injectors
    SETBIT(TIMSK2, OCIE2B);
    SETBIT(TIFR2, OCF2B);                      //reset possible pending interrupt flag
    _END_ATOMIC_BLOCK();
   }
+  else if (inj.cfg == INJCFG_FULLSEQUENTIAL)
+   start_inj_fs(chan, 0);
   else
   {//semi-sequential
    if (!inj.tmr_chan)
@@ -349,10 +585,7 @@ void inject_open_inj(uint16_t time)
   _BEGIN_ATOMIC_BLOCK();
   OCR2B = TCNT2 + _AB(time, 0);
   inj.tmr2b_h = _AB(time, 1);
-  IOCFG_SET(IOP_INJ_OUT0, INJ_ON);            //turn on injector 1
-  IOCFG_SET(IOP_INJ_OUT1, INJ_ON);            //turn on injector 2
-  IOCFG_SET(IOP_INJ_OUT2, INJ_ON);            //turn on injector 3
-  IOCFG_SET(IOP_INJ_OUT3, INJ_ON);            //turn on injector 4
+  set_outputs(inj.all_outs, INJ_ON);                  //turn on all injectors
   SETBIT(TIMSK2, OCIE2B);
   SETBIT(TIFR2, OCF2B);                       //reset possible pending interrupt flag
   inj.prime_pulse = 1;
@@ -370,13 +603,22 @@ ISR(TIMER2_COMPB_vect)
  {
   if (inj.cfg < INJCFG_2BANK_ALTERN || inj.prime_pulse)
   {//central/simultaneous
-   IOCFG_SET(IOP_INJ_OUT0, INJ_OFF);          //turn off injector 1
-   IOCFG_SET(IOP_INJ_OUT1, INJ_OFF);          //turn off injector 2
-   IOCFG_SET(IOP_INJ_OUT2, INJ_OFF);          //turn off injector 3
-   IOCFG_SET(IOP_INJ_OUT3, INJ_OFF);          //turn off injector 4
+   set_outputs(inj.all_outs, INJ_OFF);                //turn off all injectors
    CLEARBIT(TIMSK2, OCIE2B);                  //disable this interrupt
    inj.prime_pulse = 0;
   }
+  else if (inj.cfg == INJCFG_FULLSEQUENTIAL)
+  { //full sequential, process events which time has come (including ones which must be processed very soon)
+   uint16_t now = TCNT1;
+   while(inj.fsq_size && (int16_t)(inj_fsq[inj.fsq_head].time - now) < INJ_FS_MERGE_TIME)
+   {
+    set_outputs(inj_fsq[inj.fsq_head].outs, inj_fsq[inj.fsq_head].state);
+    if (++inj.fsq_head == INJ_FSQ_SIZE)       //remove event from head of the queue
+     inj.fsq_head = 0;
+    --inj.fsq_size;
+   }
+   fs_arm_timer();                            //set timer for the next event or disable interrupt
+  }
   else
   { //semi-sequential
    uint8_t chan_idx = QUEUE_TAIL(1).chan_idx;
@@ -419,10 +661,7 @@ ISR(TIMER0_COMPB_vect)
  {
   if (inj.cfg < INJCFG_2BANK_ALTERN)
   { //central/simultaneous
-   IOCFG_SET(IOP_INJ_OUT0, INJ_OFF);          //turn off injector 1
-   IOCFG_SET(IOP_INJ_OUT1, INJ_OFF);          //turn off injector 2
-   IOCFG_SET(IOP_INJ_OUT2, INJ_OFF);          //turn off injector 3
-   IOCFG_SET(IOP_INJ_OUT3, INJ_OFF);          //turn off injector 4
+   set_outputs(inj.all_outs, INJ_OFF);                //turn off all injectors
    CLEARBIT(TIMSK0, OCIE0B);                  //disable this interrupt
   }
   else
@@ -64,6 +64,18 @@ void inject_set_fuelcut(uint8_t state);
  */
 void inject_start_inj(uint8_t chan);
 
+/**Start injection after specified delay. Delay is counted out only in full sequential mode,
+ * in other modes injection starts immediately. Must be called synchronously with crankshaft
+ * \param chan Channel number
+ * \param delay Delay before opening of injector, one tick = 3.2us
+ */
+void inject_start_inj_delayed(uint8_t chan, uint16_t delay);
+
+/** Checks whether delay of start of injection is counted out in the current configuration
+ * \return 1 - delay is counted out (full sequential mode), 0 - delay is ignored by inject_start_inj_delayed()
+ */
+uint8_t inject_is_delay_supported(void);
+
 /** This function directly opens injectors, used for priming pulse (before cranking)
  * \param time Injection time, one tick = 3.2us
  */
@@ -74,6 +86,19 @@ void inject_open_inj(uint16_t time);
  */
 void inject_set_config(uint8_t cfg);
 
+/** Tell injector module that phase of engine cycle is known (cam sensor works), so full sequential
+ * injection can be performed. Otherwise injectors are opened in pairs (each injector once per cycle)
+ * \param phased 1 - phase is known, 0 - phase is unknown
+ */
+void inject_set_phased(uint8_t phased);
+
+/** Checks for errors (queue of full sequential mode was full and pulse was skipped)
+ * \return value > 0 if error occured before or between calls of this fuction, otherwise 0 */
+uint8_t inject_is_error(void);
+
+/** Reset internal error flag */
+void inject_reset_error(void);
+
 #endif //FUEL_INJECT
 
 #endif //_INJECTOR_H_
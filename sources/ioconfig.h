@@ -102,17 +102,22 @@ typedef uint8_t (*iocfg_pfn_get)(void);
 #define IOP_IAC_PWM      59     //!< IAC_PWM         (output)
 #define IOP_GD_DIR       60     //!< GD_DIR          (output)
 #define IOP_GD_STP       61     //!< GD_STP          (output)
-#define IOP_RESERVED23   62     //!< reserved plug   ()
-#define IOP_RESERVED24   63     //!< reserved plug   ()
-#define IOP_RESERVED25   64     //!< reserved plug   ()
-#define IOP_RESERVED26   65     //!< reserved plug   ()
+#define IOP_INJ_OUT4     62     //!< INJ_OUT4        (output)
+#define IOP_INJ_OUT5     63     //!< INJ_OUT5        (output)
+#define IOP_INJ_OUT6     64     //!< INJ_OUT6        (output)
+#define IOP_INJ_OUT7     65     //!< INJ_OUT7        (output)
 #define IOP_RESERVED27   66     //!< reserved plug   ()
 #define IOP_RESERVED28   67     //!< reserved plug   ()
 
 #define IOP_IGN78_OFF    (IOP_IGN_OUT7-(IOP_ADD_IO2+1)) //!< needed by ckps.c
+#define IOP_INJ47_OFF    (IOP_INJ_OUT4-(IOP_INJ_OUT3+1)) //!< needed by injector.c
 
 /**Wrap macro from port/pgmspace.h. for getting function pointers from program memory */
+#ifdef HOST_SIM
+#define _IOREM_GPTR(ptr) (*(ptr))
+#else
 #define _IOREM_GPTR(ptr) PGM_GET_WORD(ptr)
+#endif
 
 /**Init specified I/O
  * io_id - ID of I/O to be initialized
@@ -28,6 +28,7 @@
 #include "port/avrio.h"
 #include "port/interrupt.h"
 #include "port/intrinsic.h"
+#include "port/pgmspace.h"
 #include "port/port.h"
 #include <stdlib.h>
 #include "bitmask.h"
@@ -52,39 +53,79 @@
  */
 #define GET_THROTTLE_GATE_STATE() (CHECKBIT(PINA, PINA7) > 0)
 
-/**Number of values for averaging of RPM for tachometer
- * -      ..    */
-#define FRQ_AVERAGING           4
-
-//      
+//Default averaging depths of measured values, used if depth is not specified in the firmware data (meas_avr_depth)
+#define FRQ_AVERAGING           4                 //!< Number of values for averaging of RPM for tachometer (-      ..   )
 #define MAP_AVERAGING           4                 //!< Number of values for averaging of pressure (MAP)
 #define BAT_AVERAGING           4                 //!< Number of values for averaging of board voltage
 #define TMP_AVERAGING           8                 //!< Number of values for averaging of coolant temperature
 #define TPS_AVERAGING           4                 //!< Number of values for averaging of throttle position
 #define AI1_AVERAGING           4                 //!< Number of values for averaging of ADD_IO1
 #define AI2_AVERAGING           4                 //!< Number of values for averaging of ADD_IO2
-#ifdef SPEED_SENSOR
 #define SPD_AVERAGING           8                 //!< Number of values for averaging of speed sensor periods
-#endif
-
-#ifdef PA4_INP_IGNTIM
 #define PA4_AVERAGING           4                 //!< Number of values for averaging of PA4
-#endif
-
-uint16_t freq_circular_buffer[FRQ_AVERAGING];     //!< Ring buffer for RPM averaging for tachometer (      )
-uint16_t map_circular_buffer[MAP_AVERAGING];      //!< Ring buffer for averaging of MAP sensor (   )
-uint16_t ubat_circular_buffer[BAT_AVERAGING];     //!< Ring buffer for averaging of voltage (    )
-uint16_t temp_circular_buffer[TMP_AVERAGING];     //!< Ring buffer for averaging of coolant temperature (    )
-uint16_t tps_circular_buffer[TPS_AVERAGING];      //!< Ring buffer for averaging of TPS
-uint16_t ai1_circular_buffer[AI1_AVERAGING];      //!< Ring buffer for averaging of ADD_IO1
-uint16_t ai2_circular_buffer[AI2_AVERAGING];      //!< Ring buffer for averaging of ADD_IO2
-#ifdef SPEED_SENSOR
-uint16_t spd_circular_buffer[SPD_AVERAGING];      //!< Ring buffer for averaging of speed sensor periods
-#endif
 
-#ifdef PA4_INP_IGNTIM
-uint16_t pa4_circular_buffer[PA4_AVERAGING];      //!< Ring buffer for averaging of PA4
-#endif
+/**Maximum averaging depth of boxcar filter (size of averaging buffers) */
+#define AVR_DEPTH_MAX           8
+/**log2 of AVR_DEPTH_MAX */
+#define AVR_SHIFT_MAX           3
+/**Maximum number of taps of median filter */
+#define MEDIAN_TAPS_MAX         5
+
+//Indexes of averaging buffers, order is the same as in meas_avr_depth
+#define AVR_FRQ                 0                 //!< RPM
+#define AVR_MAP                 1                 //!< MAP
+#define AVR_BAT                 2                 //!< board voltage
+#define AVR_TMP                 3                 //!< coolant temperature
+#define AVR_TPS                 4                 //!< throttle position
+#define AVR_AI1                 5                 //!< ADD_IO1
+#define AVR_AI2                 6                 //!< ADD_IO2
+#define AVR_SPD                 7                 //!< speed sensor periods
+#define AVR_PA4                 8                 //!< PA4
+
+/**Default averaging depths, indexed by AVR_x */
+PGM_DECLARE(uint8_t avr_depth_def[MEAS_AVR_NUMBER]) =
+ {FRQ_AVERAGING, MAP_AVERAGING, BAT_AVERAGING, TMP_AVERAGING, TPS_AVERAGING, AI1_AVERAGING, AI2_AVERAGING, SPD_AVERAGING, PA4_AVERAGING};
+
+/**Filter of measured value. Pipeline: restriction of noisy samples (optional), median pre-filter, smoothing
+ * (boxcar averaging with running sum or first-order IIR filter), slew-rate limit. All filters use fixed point
+ * arithmetic without division */
+typedef struct
+{
+ uint16_t buff[AVR_DEPTH_MAX];        //!< samples of boxcar filter (  )
+ uint16_t hist[MEDIAN_TAPS_MAX - 1];  //!< previous input samples used by median filter, hist[0] is the newest
+ uint32_t sum;                        //!< running sum of boxcar filter, or accumulator of IIR filter (output * 2^shift)
+ uint16_t out;                        //!< output of the pipeline (filtered value)
+ uint8_t  cfg;                        //!< configuration of filters (see MFLT_x)
+ uint8_t  slew;                       //!< maximum change of output per sample, 0 - no limit
+ uint8_t  shift;                      //!< log2 of boxcar depth or coefficient of IIR filter
+ uint8_t  idx;                        //!< index of boxcar's entry which will be overwritten by the next sample
+ uint8_t  primed;                     //!< 0 - state of filters will be initialized by the next sample
+ uint8_t  dirty;                      //!< set when new sample is put (only real samples are put), cleared when filtered value is taken
+ uint8_t  clamp;                      //!< 1 - input sample is restricted to +/-6.25% of output (see avr_init())
+}avrbuf_t;
+
+avrbuf_t avr[MEAS_AVR_NUMBER];        //!< filters of measured values, indexed by AVR_x
+
+/**Maximum number of cylinders for crank-synchronous sampling of MAP */
+#define MAPSYN_CYL_MAX          8
+/**Number of updates without completed MAP sampling windows, after which per-cylinder values become invalid
+ * (e.g. engine is stopped or crank-synchronous sampling is off) */
+#define MAPSYN_MAX_AGE          4
+
+/**Per-cylinder values of MAP obtained using crank-synchronous sampling */
+typedef struct
+{
+ uint16_t avg[MAPSYN_CYL_MAX];    //!< average MAP measured in the last window of each cylinder (ADC discretes)
+ uint16_t min[MAPSYN_CYL_MAX];    //!< minimum MAP measured in the last window of each cylinder (ADC discretes)
+ uint16_t sum;                    //!< sum of samples of the current window
+ uint16_t min_curr;               //!< minimum sample of the current window
+ uint8_t  cnt;                    //!< number of samples in the current window
+ uint8_t  cyl;                    //!< cylinder the current window belongs to
+ uint8_t  valid;                  //!< bit mask of cylinders which have valid values
+ uint8_t  age;                    //!< number of updates since last completed window
+}mapsyn_t;
+
+mapsyn_t mapsyn = {{0},{0},0,0xFFFF,0,0,0,0}; //!< instance of per-cylinder MAP values
 
 void meas_init_ports(void)
 {
@@ -93,59 +134,254 @@ void meas_init_ports(void)
  //and we don't need pullup resistors for them
 }
 
+/**Initializes filter of measured value using configuration from parameters
+ * \param d pointer to ECU data structure
+ * \param i index of filter (AVR_x)
+ */
+static void avr_init(struct ecudata_t* d, uint8_t i)
+{
+ avrbuf_t* p = &avr[i];
+ p->cfg = d->param.meas_flt_cfg[i];
+ p->slew = d->param.meas_flt_slew[i];
+ p->shift = MFLT_SHIFT(p->cfg);
+ //Parameters saved by previous versions of firmware have zero configuration. Coolant temperature was filtered
+ //by restricting of noisy samples to +/-6.25% of averaged value, so we keep this filter for them.
+ p->clamp = (AVR_TMP == i && 0 == p->cfg);
+ if (!CHECKBIT(p->cfg, MFLT_IIR))
+ { //boxcar
+  if (0==p->shift)
+  { //depth is specified in the firmware data
+   uint8_t depth = PGM_GET_BYTE(&fw_data.exdata.meas_avr_depth[i]);
+   if (!depth || depth > AVR_DEPTH_MAX)
+    depth = PGM_GET_BYTE(&avr_depth_def[i]);
+   for(; (2 << p->shift) <= depth; ++p->shift); //depth is rounded down to power of 2
+  }
+  else if (p->shift > AVR_SHIFT_MAX)
+   p->shift = AVR_SHIFT_MAX;
+ }
+ p->primed = 0, p->dirty = 0;
+}
+
+/**Median of 3 values
+ * \return median value
+ */
+static uint16_t median3(uint16_t a, uint16_t b, uint16_t c)
+{
+ if (a > b)
+ {
+  uint16_t t = a; a = b; b = t;     //now a <= b
+ }
+ return (c <= a) ? a : ((c >= b) ? b : c);
+}
+
+/**Median of 5 values (array is sorted)
+ * \param v pointer to array of 5 values
+ * \return median value
+ */
+static uint16_t median5(uint16_t* v)
+{
+ uint8_t i, j;
+ for(i = 1; i < 5; ++i)
+ {
+  uint16_t t = v[i];
+  for(j = i; j && v[j - 1] > t; --j)
+   v[j] = v[j - 1];
+  v[j] = t;
+ }
+ return v[2];
+}
+
+/**Puts new sample into filter and calculates new filtered value
+ * \param i index of filter (AVR_x)
+ * \param value new sample
+ */
+static void avr_put(uint8_t i, uint16_t value)
+{
+ avrbuf_t* p = &avr[i];
+ uint16_t y;
+ uint8_t j;
+
+ if (!p->primed)
+ { //state of all filters is initialized by the first sample, so there is no lag at the start up
+  for(j = 0; j < AVR_DEPTH_MAX; ++j)
+   p->buff[j] = value;
+  for(j = 0; j < MEDIAN_TAPS_MAX - 1; ++j)
+   p->hist[j] = value;
+  p->sum = ((uint32_t)value) << p->shift;  //the same for boxcar and IIR
+  p->idx = 0;
+  p->out = value;
+  p->primed = 1, p->dirty = 1;
+  return;
+ }
+
+ //restriction of noisy samples (threshold is 6.25%)
+ if (p->clamp)
+ {
+  uint16_t t = (p->out >> 4);
+  if (value > (p->out + t))
+   value = p->out + t;
+  else if (value < (p->out - t))
+   value = p->out - t;
+ }
+
+ //median pre-filter
+ switch(p->cfg & MFLT_MEDIAN_MASK)
+ {
+  case MFLT_MEDIAN3:
+   y = median3(value, p->hist[0], p->hist[1]);
+   break;
+  case MFLT_MEDIAN5:
+  {
+   uint16_t v[MEDIAN_TAPS_MAX] = {value, p->hist[0], p->hist[1], p->hist[2], p->hist[3]};
+   y = median5(v);
+  }
+  break;
+  default:
+   y = value;
+ }
+ for(j = MEDIAN_TAPS_MAX - 2; j; --j)
+  p->hist[j] = p->hist[j - 1];
+ p->hist[0] = value;
+
+ //smoothing
+ if (CHECKBIT(p->cfg, MFLT_IIR))
+  p->sum = p->sum - (p->sum >> p->shift) + y; //acc+= x - acc / 2^k, output = acc / 2^k
+ else
+ {
+  p->sum = p->sum - p->buff[p->idx] + y;      //running sum of boxcar
+  p->buff[p->idx] = y;
+  p->idx = (p->idx + 1) & ((1 << p->shift) - 1);
+ }
+ y = p->sum >> p->shift;
+
+ //slew-rate limit
+ if (p->slew)
+ {
+  if (y > p->out && (y - p->out) > p->slew)
+   y = p->out + p->slew;
+  else if (y < p->out && (p->out - y) > p->slew)
+   y = p->out - p->slew;
+ }
+
+ p->out = y;
+ p->dirty = 1;
+}
+
+/**Takes filtered value and clears dirty flag
+ * \param i index of filter (AVR_x)
+ * \return filtered value
+ */
+static uint16_t avr_get(uint8_t i)
+{
+ avr[i].dirty = 0;
+ return avr[i].out;
+}
+
+/**Takes samples of analog channel which were accumulated by ADC since previous call
+ * \param ch logical number of ADC channel (ADCCH_x)
+ * \param p_value pointer to variable which will receive mean value of new samples (not changed if there are no new samples)
+ * \return number of new samples, 0 - channel was not sampled since previous call (e.g. slow channels)
+ */
+static uint8_t take_samples(uint8_t ch, uint16_t* p_value)
+{
+ uint16_t sum;
+ uint8_t n = adc_rb_read(ch, &sum);
+ if (n)
+  *p_value = sum / n;
+ return n;
+}
+
+/**Takes crank-synchronous samples of MAP, and updates values of cylinder when its window is completed */
+static void take_mapsyn_samples(void)
+{
+ uint16_t value;
+ uint8_t tag, cyl;
+ while(adc_mapsyn_read(&value, &tag))
+ {
+  cyl = tag & ~ADC_MAPSYN_LAST;
+  if (cyl != mapsyn.cyl)
+  { //window of other cylinder, previous one was not completed (its last sample was lost)
+   mapsyn.cyl = cyl;
+   mapsyn.sum = 0, mapsyn.cnt = 0, mapsyn.min_curr = 0xFFFF;
+  }
+  mapsyn.sum+= value;
+  ++mapsyn.cnt;
+  if (value < mapsyn.min_curr)
+   mapsyn.min_curr = value;
+
+  if ((tag & ADC_MAPSYN_LAST) && cyl < MAPSYN_CYL_MAX)
+  { //window is completed
+   mapsyn.avg[cyl] = mapsyn.sum / mapsyn.cnt;
+   mapsyn.min[cyl] = mapsyn.min_curr;
+   mapsyn.valid|= _BV(cyl);
+   mapsyn.age = 0;
+   mapsyn.sum = 0, mapsyn.cnt = 0, mapsyn.min_curr = 0xFFFF;
+  }
+ }
+
+ if (mapsyn.age < MAPSYN_MAX_AGE)
+  ++mapsyn.age;
+ else
+  mapsyn.valid = 0; //values are too old
+}
+
 //   ( , ...)
 void meas_update_values_buffers(struct ecudata_t* d, uint8_t rpm_only)
 {
- static uint8_t  map_ai  = MAP_AVERAGING-1;
- static uint8_t  bat_ai  = BAT_AVERAGING-1;
- static uint8_t  tmp_ai  = TMP_AVERAGING-1;
- static uint8_t  frq_ai  = FRQ_AVERAGING-1;
- static uint8_t  tps_ai  = TPS_AVERAGING-1;
- static uint8_t  ai1_ai  = AI1_AVERAGING-1;
- static uint8_t  ai2_ai  = AI2_AVERAGING-1;
-#ifdef SPEED_SENSOR
- static uint8_t  spd_ai = SPD_AVERAGING-1;
-#endif
-#ifdef PA4_INP_IGNTIM
-  static uint8_t  pa4_ai  = PA4_AVERAGING-1;
-#endif
+ uint16_t value = 0, tps = 0;
+ uint8_t n, tps_n;
 
- freq_circular_buffer[frq_ai] = d->sens.inst_frq;
- (frq_ai==0) ? (frq_ai = FRQ_AVERAGING - 1): frq_ai--;
+ avr_put(AVR_FRQ, d->sens.inst_frq);
 
  if (rpm_only)
   return;
 
- map_circular_buffer[map_ai] = (d->param.load_src_cfg==0) ? adc_get_map_value() : adc_get_carb_value();
+ //Filters are updated only by new samples. Slow channels are sampled not on each stroke, and if we put the same
+ //sample again and again, then time constants of filters would depend on RPM
+ tps_n = take_samples(ADCCH_CARB, &tps);
+
+ take_mapsyn_samples();
+
+ if (d->param.load_src_cfg==0)
+  n = take_samples(ADCCH_MAP, &value);
+ else
+  n = tps_n, value = tps;
+ if (n)
+ {
+  avr_put(AVR_MAP, value);
 #ifdef SEND_INST_VAL
- d->sens.inst_map = map_adc_to_kpa(adc_compensate(_RESDIV(map_circular_buffer[map_ai], 2, 1), d->param.map_adc_factor, d->param.map_adc_correction), d->param.map_curve_offset, d->param.map_curve_gradient);
+  d->sens.inst_map = map_adc_to_kpa(adc_compensate(_RESDIV(value, 2, 1), d->param.map_adc_factor, d->param.map_adc_correction), d->param.map_curve_offset, d->param.map_curve_gradient);
 #endif
- (map_ai==0) ? (map_ai = MAP_AVERAGING - 1): map_ai--;
+ }
 
- ubat_circular_buffer[bat_ai] = adc_get_ubat_value();
+ if (take_samples(ADCCH_UBAT, &value))
+ {
+  avr_put(AVR_BAT, value);
 #ifdef SEND_INST_VAL
- d->sens.inst_voltage = adc_compensate(ubat_circular_buffer[bat_ai] * 6, d->param.ubat_adc_factor, d->param.ubat_adc_correction);
+  d->sens.inst_voltage = adc_compensate(value * 6, d->param.ubat_adc_factor, d->param.ubat_adc_correction);
 #endif
- (bat_ai==0) ? (bat_ai = BAT_AVERAGING - 1): bat_ai--;
+ }
 
- temp_circular_buffer[tmp_ai] = adc_get_temp_value();
- (tmp_ai==0) ? (tmp_ai = TMP_AVERAGING - 1): tmp_ai--;
+ if (take_samples(ADCCH_TEMP, &value))
+  avr_put(AVR_TMP, value);
 
- tps_circular_buffer[tps_ai] = adc_get_carb_value();
- (tps_ai==0) ? (tps_ai = TPS_AVERAGING - 1): tps_ai--;
+ if (tps_n)
+  avr_put(AVR_TPS, tps);
 
- ai1_circular_buffer[ai1_ai] = adc_get_add_io1_value();
+ if (take_samples(ADCCH_ADD_IO1, &value))
+ {
+  avr_put(AVR_AI1, value);
 #ifdef SEND_INST_VAL
- d->sens.inst_add_i1 = adc_compensate(_RESDIV(ai1_circular_buffer[ai1_ai], 2, 1), d->param.ai1_adc_factor, d->param.ai1_adc_correction);
+  d->sens.inst_add_i1 = adc_compensate(_RESDIV(value, 2, 1), d->param.ai1_adc_factor, d->param.ai1_adc_correction);
 #endif
- (ai1_ai==0) ? (ai1_ai = AI1_AVERAGING - 1): ai1_ai--;
+ }
 
- ai2_circular_buffer[ai2_ai] = adc_get_add_io2_value();
- (ai2_ai==0) ? (ai2_ai = AI2_AVERAGING - 1): ai2_ai--;
+ if (take_samples(ADCCH_ADD_IO2, &value))
+  avr_put(AVR_AI2, value);
 
 #ifdef PA4_INP_IGNTIM
- pa4_circular_buffer[pa4_ai] = adc_get_pa4_value();
- (pa4_ai==0) ? (pa4_ai = PA4_AVERAGING - 1): pa4_ai--;
+ if (take_samples(ADCCH_PA4, &value))
+  avr_put(AVR_PA4, value);
 #endif
 
  if (d->param.knock_use_knock_channel)
@@ -160,8 +396,8 @@ void meas_update_values_buffers(struct ecudata_t* d, uint8_t rpm_only)
   d->sens.knock_k = 0; //knock signal value must be zero if knock detection turned off
 
 #ifdef SPEED_SENSOR
- spd_circular_buffer[spd_ai] = spdsens_get_period();
- (spd_ai==0) ? (spd_ai = SPD_AVERAGING - 1): spd_ai--;
+ //period is held by camsens.c until next pulse or timeout (0xFFFF), so it is put on each update
+ avr_put(AVR_SPD, spdsens_get_period());
  d->sens.distance = spdsens_get_pulse_count();
 #endif
 
@@ -178,94 +414,106 @@ void meas_update_values_buffers(struct ecudata_t* d, uint8_t rpm_only)
 
 
 //        , 
-// ,      .
+// ,      . Only values which have new
+//samples in their filters are processed, so conversions of slow channels are performed at their sampling rate.
 void meas_average_measured_values(struct ecudata_t* d)
 {
  uint8_t i;  uint32_t sum;
- static uint16_t temp_avr = 0;
+ uint8_t cyl_mask = (uint8_t)((1 << d->param.ckps_engine_cyl) - 1);
 
- for (sum=0,i = 0; i < MAP_AVERAGING; i++)  //     
-  sum+=map_circular_buffer[i];
- d->sens.map_raw = adc_compensate(_RESDIV((sum/MAP_AVERAGING), 2, 1), d->param.map_adc_factor, d->param.map_adc_correction);
- d->sens.map = map_adc_to_kpa(d->sens.map_raw, d->param.map_curve_offset, d->param.map_curve_gradient);
+ if (avr[AVR_MAP].dirty)
+ {
+  sum = avr_get(AVR_MAP);                   //     
+  if (0==d->param.load_src_cfg && (mapsyn.valid & cyl_mask) == cyl_mask)
+  { //use values measured in the windows of all cylinders (one engine cycle) instead of MAP_AVERAGING strokes
+   uint8_t use_min = (PGM_GET_BYTE(&fw_data.exdata.map_wnd_mode) == MAPWND_MINIMUM);
+   for (sum=0,i = 0; i < d->param.ckps_engine_cyl; i++)
+    sum+= use_min ? mapsyn.min[i] : mapsyn.avg[i];
+   sum/= d->param.ckps_engine_cyl;
+  }
+  d->sens.map_raw = adc_compensate(_RESDIV(sum, 2, 1), d->param.map_adc_factor, d->param.map_adc_correction);
+  d->sens.map = map_adc_to_kpa(d->sens.map_raw, d->param.map_curve_offset, d->param.map_curve_gradient);
+ }
 
- for (sum=0,i = 0; i < BAT_AVERAGING; i++)   //   
-  sum+=ubat_circular_buffer[i];
- d->sens.voltage_raw = adc_compensate((sum/BAT_AVERAGING) * 6, d->param.ubat_adc_factor,d->param.ubat_adc_correction);
- d->sens.voltage = ubat_adc_to_v(d->sens.voltage_raw);
+ if (avr[AVR_BAT].dirty)                    //   
+ {
+  d->sens.voltage_raw = adc_compensate(avr_get(AVR_BAT) * 6, d->param.ubat_adc_factor,d->param.ubat_adc_correction);
+  d->sens.voltage = ubat_adc_to_v(d->sens.voltage_raw);
+ }
 
  if (d->param.tmp_use)
  {
-  for (sum=0,i = 0; i < TMP_AVERAGING; i++) //  ()
-  { //filter noisy samples by comparing each sample with averaged value (threshold is 6.25%)
-   uint16_t t = (temp_avr >> 4);
-   if (temp_avr && (temp_circular_buffer[i] > (temp_avr + t)))
-    sum+=(temp_avr + t);
-   else if (temp_avr && (temp_circular_buffer[i] < ((int16_t)temp_avr - t)))
-    sum+=(temp_avr - t);
-   else
-    sum+=temp_circular_buffer[i];
-  }
-  temp_avr = sum/TMP_AVERAGING;
-  d->sens.temperat_raw = adc_compensate(_RESDIV(temp_avr, 5, 3),d->param.temp_adc_factor,d->param.temp_adc_correction);
+  if (avr[AVR_TMP].dirty)                   //  ()
+  {
+   d->sens.temperat_raw = adc_compensate(_RESDIV(avr_get(AVR_TMP), 5, 3),d->param.temp_adc_factor,d->param.temp_adc_correction);
 #ifndef THERMISTOR_CS
-  d->sens.temperat = temp_adc_to_c(d->sens.temperat_raw);
-#else
-  if (!d->param.cts_use_map) //use linear sensor
    d->sens.temperat = temp_adc_to_c(d->sens.temperat_raw);
-  else //use lookup table (actual for thermistor sensors)
-   d->sens.temperat = thermistor_lookup(d->sens.temperat_raw);
+#else
+   if (!d->param.cts_use_map) //use linear sensor
+    d->sens.temperat = temp_adc_to_c(d->sens.temperat_raw);
+   else //use lookup table (actual for thermistor sensors)
+    d->sens.temperat = thermistor_lookup(d->sens.temperat_raw);
 #endif
+  }
  }
  else                                       //  
   d->sens.temperat = 0;
 
- for (sum=0,i = 0; i < FRQ_AVERAGING; i++)  //   
-  sum+=freq_circular_buffer[i];
- d->sens.frequen=(sum/FRQ_AVERAGING);
+ if (avr[AVR_FRQ].dirty)                    //   
+  d->sens.frequen = avr_get(AVR_FRQ);
 
 #ifdef SPEED_SENSOR
- for (sum=0,i = 0; i < SPD_AVERAGING; i++)  //average periods from speed sensor
-  sum+=spd_circular_buffer[i];
- d->sens.speed=(sum/SPD_AVERAGING);
+ if (avr[AVR_SPD].dirty)                    //average periods from speed sensor
+  d->sens.speed = avr_get(AVR_SPD);
 #endif
 
- for (sum=0,i = 0; i < TPS_AVERAGING; i++)   //average throttle position
-  sum+=tps_circular_buffer[i];
- d->sens.tps_raw = adc_compensate(_RESDIV((sum/TPS_AVERAGING), 2, 1), d->param.tps_adc_factor, d->param.tps_adc_correction);
- d->sens.tps = tps_adc_to_pc(d->sens.tps_raw, d->param.tps_curve_offset, d->param.tps_curve_gradient);
- if (d->sens.tps > TPS_MAGNITUDE(100))
-  d->sens.tps = TPS_MAGNITUDE(100);
-
- for (sum=0,i = 0; i < AI1_AVERAGING; i++)   //average ADD_IO1 input
-  sum+=ai1_circular_buffer[i];
- d->sens.add_i1_raw = adc_compensate(_RESDIV((sum/AI1_AVERAGING), 2, 1), d->param.ai1_adc_factor, d->param.ai1_adc_correction);
- d->sens.add_i1 = d->sens.add_i1_raw;
+ if (avr[AVR_TPS].dirty)                    //average throttle position
+ {
+  d->sens.tps_raw = adc_compensate(_RESDIV(avr_get(AVR_TPS), 2, 1), d->param.tps_adc_factor, d->param.tps_adc_correction);
+  d->sens.tps = tps_adc_to_pc(d->sens.tps_raw, d->param.tps_curve_offset, d->param.tps_curve_gradient);
+  if (d->sens.tps > TPS_MAGNITUDE(100))
+   d->sens.tps = TPS_MAGNITUDE(100);
+ }
 
- for (sum=0,i = 0; i < AI2_AVERAGING; i++)   //average ADD_IO2 input
-  sum+=ai2_circular_buffer[i];
- d->sens.add_i2_raw = adc_compensate(_RESDIV((sum/AI2_AVERAGING), 2, 1), d->param.ai2_adc_factor, d->param.ai2_adc_correction);
- d->sens.add_i2 = d->sens.add_i2_raw;
+ if (avr[AVR_AI1].dirty)                    //average ADD_IO1 input
+ {
+  d->sens.add_i1_raw = adc_compensate(_RESDIV(avr_get(AVR_AI1), 2, 1), d->param.ai1_adc_factor, d->param.ai1_adc_correction);
+  d->sens.add_i1 = d->sens.add_i1_raw;
+ }
 
-#ifdef PA4_INP_IGNTIM
- for (sum=0,i = 0; i < PA4_AVERAGING; i++)   //average PA4 input
-  sum+=pa4_circular_buffer[i];
- d->sens.pa4 = adc_compensate((sum/PA4_AVERAGING), ADC_COMP_FACTOR(ADC_VREF_FACTOR), 0);
+ if (avr[AVR_AI2].dirty)                    //average ADD_IO2 input
+ {
+  d->sens.add_i2_raw = adc_compensate(_RESDIV(avr_get(AVR_AI2), 2, 1), d->param.ai2_adc_factor, d->param.ai2_adc_correction);
+  d->sens.add_i2 = d->sens.add_i2_raw;
+#ifdef AIRTEMP_SENS
+  if (IOCFG_CHECK(IOP_AIR_TEMP))
+   d->sens.air_temp = ats_lookup(d->sens.add_i2_raw);   //ADD_IO2 input
+  else
+   d->sens.air_temp = 0; //input is not selected
 #endif
+ }
 
-#ifdef AIRTEMP_SENS
- if (IOCFG_CHECK(IOP_AIR_TEMP))
-  d->sens.air_temp = ats_lookup(d->sens.add_i2_raw);   //ADD_IO2 input
- else
-  d->sens.air_temp = 0; //input is not selected
+#ifdef PA4_INP_IGNTIM
+ if (avr[AVR_PA4].dirty)                    //average PA4 input
+  d->sens.pa4 = adc_compensate(avr_get(AVR_PA4), ADC_COMP_FACTOR(ADC_VREF_FACTOR), 0);
 #endif
 }
 
 //      .   
 // .
+void meas_init_filters(struct ecudata_t* d)
+{
+ uint8_t i = 0;
+ for(; i < MEAS_AVR_NUMBER; ++i)
+  avr_init(d, i);
+}
+
 void meas_initial_measure(struct ecudata_t* d)
 {
- uint8_t _t,i = 16;
+ uint8_t _t,i;
+ meas_init_filters(d);
+
+ i = 16;
  _t = _SAVE_INTERRUPT();
  _ENABLE_INTERRUPT();
  do
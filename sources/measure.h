@@ -45,6 +45,12 @@ void meas_update_values_buffers(struct ecudata_t* d, uint8_t rpm_only);
  */
 void meas_average_measured_values(struct ecudata_t* d);
 
+/**Initialization of filters of measured values using their configuration from parameters (meas_flt_cfg, meas_flt_slew).
+ * Filtered values are kept, state of filters is initialized by the next sample of each value
+ * \param d pointer to ECU data structure
+ */
+void meas_init_filters(struct ecudata_t* d);
+
 /**Initialization of ring buffers. Performs initial measurements. Used before start of engine
  * \param d pointer to ECU data structure
  */
@@ -46,12 +46,12 @@
 void save_param_if_need(struct ecudata_t* d)
 {
  //     ?
- if (s_timer16_is_action(save_param_timeout_counter))
+ if (s_timer_is_action(save_param_timeout_counter))
  {
   //    ?
   if (memcmp(d->eeprom_parameters_cache, &d->param, sizeof(params_t)-PAR_CRC_SIZE))
    sop_set_operation(SOP_SAVE_PARAMETERS);
-  s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+  s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
  }
 }
 
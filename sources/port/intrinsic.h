@@ -42,6 +42,22 @@
 
  #define CALL_ADDRESS(addr) ((void (*)())((addr)/2))()
 
+#elif defined(HOST_SIM) //GCC, host build with simulated MCU (see host/avrsim.c)
+ #include <avr/eeprom.h>
+ #include <avr/interrupt.h>
+
+ //abstracting intrinsics
+ #define _ENABLE_INTERRUPT() sei()
+ #define _DISABLE_INTERRUPT() cli()
+ #define _SAVE_INTERRUPT() SREG
+ #define _RESTORE_INTERRUPT(s) SREG = (s)
+ #define _NO_OPERATION() ((void)0)
+ #define _DELAY_CYCLES(cycles) ((void)(cycles))
+ #define _DELAY_US(us) ((void)(us))
+ #define _WATCHDOG_RESET() ((void)0)
+
+ #define CALL_ADDRESS(addr) ((void)(addr))
+
 #else //AVR GCC
  #include <avr/eeprom.h>       //__EEGET(), __EEPUT() etc
 
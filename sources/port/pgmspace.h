@@ -44,6 +44,21 @@ __flash variable@sect_name
 
  #define _PGM __flash
 
+#elif defined(HOST_SIM) //GCC, host build with simulated MCU
+ #include <avr/pgmspace.h>
+
+ //Declare variable in FLASH at fixed address
+ #define PGM_FIXED_ADDR_OBJ(variable, sect_name) variable
+
+ //Declare variable in FLASH
+ #define PGM_DECLARE(x) const x
+
+ #define PGM_GET_BYTE(addr) pgm_read_byte(addr)
+ #define PGM_GET_WORD(addr) pgm_read_word(addr)
+ #define PGM_GET_DWORD(addr) pgm_read_dword(addr)
+
+ #define _PGM const
+
 #else //AVR GCC
  #include <avr/pgmspace.h>
 
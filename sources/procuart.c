@@ -25,6 +25,7 @@
  * (     /    (UART)).
  */
 
+#include "port/avrio.h"
 #include "port/pgmspace.h"
 #include "port/intrinsic.h"
 #include "port/port.h"
@@ -38,6 +39,7 @@
 #include "ecudata.h"
 #include "injector.h"
 #include "knock.h"
+#include "measure.h"
 #include "params.h"
 #include "procuart.h"
 #include "suspendop.h"
@@ -46,6 +48,15 @@
 #include "ventilator.h"
 #include "vstimer.h"
 
+/**Number of timer 1 ticks in 1 ms (1 tick = 3.2us) */
+#define DLOG_TICKS_PER_MS 312
+
+/**Maximum period of datalog frames in ms, limited by the 16-bit timer */
+#define DLOG_PERIOD_MAX   200
+
+/**Value of timer 1 at the moment when last datalog frame was sent */
+static uint16_t dlog_time = 0;
+
 void process_uart_interface(struct ecudata_t* d)
 {
  uint8_t descriptor;
@@ -63,7 +74,12 @@ void process_uart_interface(struct ecudata_t* d)
  }
 #endif
 
- if (uart_is_packet_received())//   ?
+ //New frames are not processed while acknowledgement of previous block of tables is pending
+ if (uart_is_packet_received()
+#ifdef REALTIME_TABLES
+     && TBOP_ACK != uart_get_tabblk_op()
+#endif
+    )//   ?
  {
   descriptor = uart_recept_packet(d);
   switch(descriptor)
@@ -80,7 +96,7 @@ void process_uart_interface(struct ecudata_t* d)
    case GASDOSE_PAR:
 #endif
     //       
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
     break;
 
 #ifdef FUEL_INJECT
@@ -89,26 +105,32 @@ void process_uart_interface(struct ecudata_t* d)
     inject_set_config(d->param.inj_config >> 4);        //type of injection
    case ACCEL_PAR:
     //       
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
     break;
 #endif
 
 #if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
    case LAMBDA_PAR:
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE); //paramaters were altered, so reset time counter
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE); //paramaters were altered, so reset time counter
     break;
 #endif
 
+   case MFLT_PAR:
+    meas_init_filters(d);               //new configuration takes effect immediately
+   case DLOG_PAR:
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE); //paramaters were altered, so reset time counter
+    break;
+
    case MISCEL_PAR:
 #ifdef HALL_OUTPUT
     ckps_set_hall_pulse(d->param.hop_start_cogs, d->param.hop_durat_cogs);
 #endif
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
     break;
 
    case FUNSET_PAR:
     //       
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
     break;
 
    case OP_COMP_NC:
@@ -172,12 +194,13 @@ void process_uart_interface(struct ecudata_t* d)
     ckps_set_edge_type(d->param.ckps_edge_type);     //CKPS ()
     cams_vr_set_edge_type(d->param.ref_s_edge_type); //REF_S ()
     ckps_set_cogs_btdc(d->param.ckps_cogs_btdc);
+    ckps_set_map_window(PGM_GET_WORD(&fw_data.exdata.map_wnd_begin), PGM_GET_WORD(&fw_data.exdata.map_wnd_width)); //<--depends on teeth and cylinders
     ckps_set_merge_outs(d->param.merge_ign_outs);
 
 #ifndef DWELL_CONTROL
     ckps_set_ignition_cogs(d->param.ckps_ignit_cogs);
 #endif
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
 
 #if defined(HALL_SYNC) || defined(CKPS_NPLUS1)
     ckps_set_shutter_wnd_width(d->param.hall_wnd_width);
@@ -213,7 +236,7 @@ void process_uart_interface(struct ecudata_t* d)
     d->use_knock_channel_prev = d->param.knock_use_knock_channel;
 
     //       
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
     break;
 
    case SECUR_PAR:
@@ -221,7 +244,7 @@ void process_uart_interface(struct ecudata_t* d)
     if (d->bt_name[0] && d->bt_pass[0])
      bt_start_set_namepass();
 #endif
-    s_timer16_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
+    s_timer_set(save_param_timeout_counter, SAVE_PARAM_TIMEOUT_VALUE);
     break;
   }
 
@@ -229,23 +252,54 @@ void process_uart_interface(struct ecudata_t* d)
   uart_notify_processed();
  }
 
+#ifdef REALTIME_TABLES
+ //bulk transfer of tables has priority over periodic packets, blocks are sent back-to-back
+ if (uart_get_tabblk_op())
+ {
+  if (!uart_is_sender_busy())
+   uart_send_packet(d, TABBLK_PAR);
+  return;
+ }
+#endif
+
+ if (DATLOG_DAT==uart_get_send_mode())
+ { //datalog mode: frames are sent with period specified in ms (10ms timers are too slow for that)
+  if (d->param.dlog_period && !uart_is_sender_busy())
+  {
+   uint16_t t, period = (d->param.dlog_period > DLOG_PERIOD_MAX ? DLOG_PERIOD_MAX : d->param.dlog_period) * DLOG_TICKS_PER_MS;
+   _BEGIN_ATOMIC_BLOCK();
+   t = TCNT1;
+   _END_ATOMIC_BLOCK();
+   if ((uint16_t)(t - dlog_time) >= period)
+   {
+    dlog_time = t;
+    uart_send_dlog_frame(d);
+   }
+  }
+ }
  //    
- if (s_timer_is_action(send_packet_interval_counter))
+ else if (s_timer_is_action(send_packet_interval_counter))
  {
   if (!uart_is_sender_busy())
   {
    uint8_t desc = uart_get_send_mode();
    uart_send_packet(d, 0);                  //    
 #ifdef DEBUG_VARIABLES
-   if (SENSOR_DAT==desc || ADCRAW_DAT==desc || CE_ERR_CODES==desc || DIAGINP_DAT==desc)
+   if (SENSOR_DAT==desc || SENDLT_DAT==desc || ADCRAW_DAT==desc || CE_ERR_CODES==desc || DIAGINP_DAT==desc)
     sop_set_operation(SOP_DBGVAR_SENDING); //additionally we will send packet with debug information
 #endif
 
    s_timer_set(send_packet_interval_counter, d->param.uart_period_t_ms);
 
    //    ,       1  2 
-   if (SENSOR_DAT==desc || CE_ERR_CODES==desc)
+   if (SENSOR_DAT==desc || SENDLT_DAT==desc || CE_ERR_CODES==desc)
     d->ecuerrors_for_transfer = 0;
   }
  }
 }
+
+void process_uart_stroke(struct ecudata_t* d)
+{
+ if (DATLOG_DAT==uart_get_send_mode() && !d->param.dlog_period && !uart_is_sender_busy())
+  uart_send_dlog_frame(d);
+}
@@ -36,4 +36,10 @@ struct ecudata_t;
  */
 void process_uart_interface(struct ecudata_t* d);
 
+/** Sends binary datalog frame if datalog mode is active and frames must be sent on each engine stroke.
+ * Should be called from main loop on each engine stroke, after all values of the stroke have been calculated
+ * \param d pointer to ECU data structure
+ */
+void process_uart_stroke(struct ecudata_t* d);
+
 #endif //_PROCUART_H_
@@ -0,0 +1,165 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+
+/** \file profiler.c
+ * \author Alexey A. Shabelnikov
+ * Implementation of run-time profiling of interrupt service routines and of the main loop
+ */
+
+#if defined(ISR_PROFILING) || defined(LOOP_PROFILING)
+
+#include "port/avrio.h"
+#include "port/interrupt.h"
+#include "port/intrinsic.h"
+#include "port/port.h"
+#include <string.h>
+#include "profiler.h"
+
+#ifdef ISR_PROFILING
+
+/**Statistics for all profiled vectors */
+isrprof_t isrprof[ISRPROF_NUMBER] = {{0xFFFF,0,0,0},{0xFFFF,0,0,0},{0xFFFF,0,0,0},{0xFFFF,0,0,0},{0xFFFF,0,0,0}};
+
+void isrprof_update(uint8_t id, uint16_t time)
+{
+ isrprof_t* p = &isrprof[id];
+ if (p->count == 0xFFFF)
+  return; //counter is full, wait until statistics will be taken out
+ if (time < p->min)
+  p->min = time;
+ if (time > p->max)
+  p->max = time;
+ p->sum+= time;
+ ++p->count;
+}
+
+void isrprof_take(uint8_t id, isrprof_t* p)
+{
+ _BEGIN_ATOMIC_BLOCK();
+ memcpy(p, &isrprof[id], sizeof(isrprof_t));
+ isrprof[id].min = 0xFFFF;
+ isrprof[id].max = 0;
+ isrprof[id].sum = 0;
+ isrprof[id].count = 0;
+ _END_ATOMIC_BLOCK();
+}
+
+#endif //ISR_PROFILING
+
+#ifdef LOOP_PROFILING
+
+/**Number of bits to shift pass time before calculation of histogram's bin */
+#define LOOPPROF_HIST_SHIFT 5
+
+/**Dividend for calculation of a half of the stroke period in timer 1 ticks:
+ * T/2 = ((312500 * 60) / (RPM * (Ncyl / 2))) / 2 = 18750000 / (RPM * Ncyl) */
+#define LOOPPROF_HALF_STROKE_DIVIDEND 18750000UL
+
+/**State variables of the main loop's profiler */
+typedef struct
+{
+ uint16_t pass_begin;                //!< value of TCNT1 at the beginning of current pass
+ uint16_t stage_begin;               //!< value of TCNT1 at the beginning of current stage
+ uint16_t prev_pass;                 //!< time of the previous pass
+ uint16_t stage_max;                 //!< time of the longest stage in current pass
+ uint8_t  stage_max_id;              //!< identifier of the longest stage in current pass
+}loopprof_state_t;
+
+/**State variables */
+loopprof_state_t lps = {0,0,0,0,0};
+
+/**Statistics of the main loop */
+loopprof_t loopprof;
+
+/**Reads TCNT1 from the main loop
+ * \return current value of timer 1
+ */
+static uint16_t get_timer1(void)
+{
+ uint16_t t;
+ _BEGIN_ATOMIC_BLOCK();
+ t = TCNT1;
+ _END_ATOMIC_BLOCK();
+ return t;
+}
+
+/**Increments 16-bit counter, prevents overflow */
+#define INC_SATURATED(v) if ((v) != 0xFFFF) ++(v)
+
+void loopprof_begin(void)
+{
+ lps.pass_begin = lps.stage_begin = get_timer1();
+ lps.stage_max = 0;
+ lps.stage_max_id = 0;
+}
+
+void loopprof_stage(uint8_t id)
+{
+ uint16_t t = get_timer1();
+ uint16_t stage_time = t - lps.stage_begin;
+ if (stage_time > lps.stage_max)
+ {
+  lps.stage_max = stage_time;
+  lps.stage_max_id = id;
+ }
+ lps.stage_begin = t;
+}
+
+void loopprof_stroke(uint16_t rpm, uint8_t cyl)
+{
+ uint16_t latency = lps.prev_pass + (get_timer1() - lps.pass_begin);
+ INC_SATURATED(loopprof.strokes);
+ if (rpm && cyl && latency > (LOOPPROF_HALF_STROKE_DIVIDEND / ((uint32_t)rpm * cyl)))
+  INC_SATURATED(loopprof.late_strokes);
+}
+
+void loopprof_end(void)
+{
+ uint8_t bin = 0;
+ uint16_t t;
+ lps.prev_pass = get_timer1() - lps.pass_begin;
+
+ //calculate log2 of pass time
+ t = lps.prev_pass >> LOOPPROF_HIST_SHIFT;
+ while(t && bin < (LOOPPROF_HIST_SIZE - 1))
+ {
+  t>>=1;
+  ++bin;
+ }
+ INC_SATURATED(loopprof.hist[bin]);
+
+ if (lps.prev_pass > loopprof.max_time)
+ {
+  loopprof.max_time = lps.prev_pass;
+  loopprof.max_stage = lps.stage_max_id;
+ }
+}
+
+void loopprof_take(loopprof_t* p)
+{
+ memcpy(p, &loopprof, sizeof(loopprof_t));
+ memset(&loopprof, 0, sizeof(loopprof_t));
+}
+
+#endif //LOOP_PROFILING
+
+#endif //ISR_PROFILING || LOOP_PROFILING
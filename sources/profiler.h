@@ -0,0 +1,163 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+
+/** \file profiler.h
+ * \author Alexey A. Shabelnikov
+ * Run-time profiling of interrupt service routines and of the main loop (used for debug purposes).
+ * Time is measured using TCNT1 (1 tick = 3.2uS)
+ */
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#ifdef ISR_PROFILING
+
+#include <stdint.h>
+#include "port/avrio.h"
+#include "port/intrinsic.h"
+
+//Identifiers of profiled interrupt vectors
+#define ISRPROF_CKPS     0   //!< TIMER1_CAPT_vect, processing of CKP/Hall sensor's edges
+#define ISRPROF_T0COMPA  1   //!< TIMER0_COMPA_vect, recovering of missing teeth, delays
+#define ISRPROF_ADC      2   //!< ADC_vect, measurement of analog inputs
+#define ISRPROF_UARTRX   3   //!< USART_RXC_vect, receiving of data through UART
+#define ISRPROF_SYSTMR   4   //!< TIMER2_OVF_vect, system timer
+#define ISRPROF_NUMBER   5   //!< Number of profiled vectors
+
+/**Statistics collected for a single interrupt vector. All time values are in ticks of timer 1 */
+typedef struct
+{
+ uint16_t min;                       //!< Minimum execution time of ISR
+ uint16_t max;                       //!< Maximum execution time of ISR
+ uint32_t sum;                       //!< Sum of execution times (used to calculate average)
+ uint16_t count;                     //!< Number of calls
+}isrprof_t;
+
+/**Must be placed at the beginning of ISR, before any other code */
+#define ISRPROF_BEGIN() uint16_t _isrprof_t = TCNT1
+
+/**Must be placed at each exit point of ISR (before return). Interrupts are disabled here
+ * (they will be enabled again by the reti instruction) to read TCNT1 and to update statistics atomically
+ * \param id Identifier of vector (see ISRPROF_xxx constants)
+ */
+#define ISRPROF_END(id) {_DISABLE_INTERRUPT(); isrprof_update((id), TCNT1 - _isrprof_t);}
+
+/**Updates statistics of specified interrupt vector. Called from interrupts only (via ISRPROF_END)
+ * \param id Identifier of vector
+ * \param time Execution time of ISR in timer 1 ticks. Note: time of nested interrupts is also
+ * included if profiled ISR enables interrupts
+ */
+void isrprof_update(uint8_t id, uint16_t time);
+
+/**Takes out statistics of specified vector and resets it (so statistics is collected between two calls)
+ * \param id Identifier of vector
+ * \param p Pointer to the structure which will receive statistics
+ */
+void isrprof_take(uint8_t id, isrprof_t* p);
+
+#else //profiling is turned off, macros do nothing
+
+#define ISRPROF_BEGIN()
+#define ISRPROF_END(id)
+
+#endif //ISR_PROFILING
+
+#ifdef LOOP_PROFILING
+
+#include <stdint.h>
+
+//Identifiers of main loop's stages (see main loop in the secu3.c)
+#define LPSTAGE_TIMERS    0  //!< detection of engine stop, forced measurements
+#define LPSTAGE_SOP       1  //!< sop_execute_operations()
+#define LPSTAGE_UART      2  //!< process_uart_interface()
+#define LPSTAGE_MEAS      3  //!< instant RPM, meas_average_measured_values(), meas_take_discrete_inputs()
+#define LPSTAGE_UNITS     4  //!< control_engine_units()
+#define LPSTAGE_SCHED     5  //!< sched_run_timed(), tasks having 10ms and 100ms rates
+#define LPSTAGE_IGNLOGIC  6  //!< ignlogic_system_state_machine() and calculations following it
+#define LPSTAGE_STROKE    7  //!< operations performed on each engine stroke
+#define LPSTAGE_FWCHECK   8  //!< check_firmware_integrity(), background check of firmware's CRC
+
+#define LOOPPROF_HIST_SIZE 10 //!< Number of bins in the histogram of loop's pass time
+
+/**Statistics collected for the main loop. All time values are in ticks of timer 1 */
+typedef struct
+{
+ /**Histogram of pass time. Bin 0 counts passes shorter than 32 ticks, bin N (N>0) counts passes
+  * which took 2^(N+4)...2^(N+5)-1 ticks, last bin counts all passes longer than 2^13 ticks */
+ uint16_t hist[LOOPPROF_HIST_SIZE];
+ uint16_t max_time;                  //!< Time of the longest pass
+ uint8_t  max_stage;                 //!< Stage which took most of the time in the longest pass
+ uint16_t strokes;                   //!< Number of serviced stroke events
+ uint16_t late_strokes;              //!< Number of stroke events which might be serviced later than a half of stroke
+}loopprof_t;
+
+/**Must be placed at the beginning of the main loop's pass */
+#define LOOPPROF_BEGIN() loopprof_begin()
+
+/**Marks end of a stage in the main loop
+ * \param id Identifier of stage (see LPSTAGE_xxx constants)
+ */
+#define LOOPPROF_STAGE(id) loopprof_stage(id)
+
+/**Must be placed at the point where stroke event is being serviced
+ * \param rpm Current RPM (min-1)
+ * \param cyl Number of engine's cylinders
+ */
+#define LOOPPROF_STROKE(rpm, cyl) loopprof_stroke((rpm), (cyl))
+
+/**Must be placed at the end of the main loop's pass */
+#define LOOPPROF_END() loopprof_end()
+
+/**Starts measurement of a new pass of the main loop */
+void loopprof_begin(void);
+
+/**Marks end of specified stage of the main loop
+ * \param id Identifier of stage
+ */
+void loopprof_stage(uint8_t id);
+
+/**Checks latency of servicing of a stroke event. Worst case latency is estimated as time of
+ * the previous pass plus time elapsed from the beginning of the current pass. Stroke is considered
+ * as late if this value is greater than a half of the stroke period
+ * \param rpm Current RPM (min-1)
+ * \param cyl Number of engine's cylinders
+ */
+void loopprof_stroke(uint16_t rpm, uint8_t cyl);
+
+/**Finishes measurement of the current pass of the main loop and updates statistics */
+void loopprof_end(void);
+
+/**Takes out statistics of the main loop and resets it
+ * \param p Pointer to the structure which will receive statistics
+ */
+void loopprof_take(loopprof_t* p);
+
+#else //profiling of the main loop is turned off, macros do nothing
+
+#define LOOPPROF_BEGIN()
+#define LOOPPROF_STAGE(id)
+#define LOOPPROF_STROKE(rpm, cyl)
+#define LOOPPROF_END()
+
+#endif //LOOP_PROFILING
+
+#endif //_PROFILER_H_
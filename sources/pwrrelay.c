@@ -86,7 +86,7 @@ void pwrrelay_control(struct ecudata_t* d)
    if (0==pwrs.state)
    {
     pwrs.state = 1;
-    s_timer16_set(powerdown_timeout_counter, 6000); //60 sec.
+    s_timer_set(powerdown_timeout_counter, 6000); //60 sec.
    }
   }
 
@@ -97,7 +97,7 @@ void pwrrelay_control(struct ecudata_t* d)
 #ifdef GD_CONTROL
       && gasdose_is_ready()
 #endif
-      ) || s_timer16_is_action(powerdown_timeout_counter))
+      ) || s_timer_is_action(powerdown_timeout_counter))
    IOCFG_SET(IOP_PWRRELAY, 0); //turn off relay
  }
  else
@@ -0,0 +1,140 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+
+/** \file sched.c
+ * \author Alexey A. Shabelnikov
+ * Implementation of cooperative scheduler. Tasks and their rates are declared in the table
+ * stored in the program memory.
+ */
+
+#include "port/pgmspace.h"
+#include "port/port.h"
+#include <stdint.h>
+#include "ce_errors.h"
+#include "choke.h"
+#include "ecudata.h"
+#include "eculogic.h"
+#include "gasdose.h"
+#include "lambda.h"
+#include "params.h"
+#include "sched.h"
+#include "tables.h"     //fnptr_t
+#include "uni_out.h"
+#include "ventilator.h"
+#include "vstimer.h"
+
+/**Number of 10ms ticks in the 100ms period */
+#define SCHED_100MS_DIVIDER 10
+
+/**Type of task's function */
+typedef void (*sched_pfn_task)(struct ecudata_t* d);
+
+/**Describes a single task */
+typedef struct
+{
+ fnptr_t task;                       //!< address of task's function
+ uint8_t rate;                       //!< rate of execution (see SCHED_RATE_xxx constants)
+}sched_task_t;
+
+/**State variables */
+typedef struct
+{
+ uint16_t last_tick;                 //!< value of the system counter at the moment of last execution of 10ms tasks
+ uint8_t  divider;                   //!< counts 10ms ticks to obtain 100ms period
+}sched_state_t;
+
+sched_state_t sched;                 //!< instance of state variables
+
+/**Wrapper used to call ce_check_engine() as a task */
+static void ce_task(struct ecudata_t* d)
+{
+ ce_check_engine(d, &ce_control_time_counter);
+}
+
+/**Helpful macro used for pointer conversion */
+#define _FNC(a) ((fnptr_t)(a))
+
+/**Table of tasks. Tasks having same rate are executed in the order of their appearance in this table */
+PGM_DECLARE(sched_task_t sched_tasks[]) =
+{
+ {_FNC(ce_task), SCHED_RATE_10MS},           //control of CE and errors detection
+ {_FNC(vent_control), SCHED_RATE_10MS},      //control of electric cooling fan
+#if defined(SM_CONTROL) || defined(FUEL_INJECT)
+ {_FNC(choke_control), SCHED_RATE_10MS},     //choke control
+#endif
+#ifdef UNI_OUTPUT
+ {_FNC(uniout_control), SCHED_RATE_10MS},    //universal programmable output control
+#endif
+#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
+ {_FNC(lambda_control), SCHED_RATE_10MS},    //lambda correction
+ {_FNC(lambda_stroke_event_notification), SCHED_RATE_STROKE},
+#endif
+ {_FNC(save_param_if_need), SCHED_RATE_100MS}, //saving of parameters
+ {_FNC(ignlogic_stroke_event_notification), SCHED_RATE_STROKE},
+#ifdef GD_CONTROL
+ {_FNC(gasdose_stroke_event_notification), SCHED_RATE_STROKE},
+#endif
+};
+
+/**Number of tasks in the table */
+#define SCHED_TASKS_NUMBER (sizeof(sched_tasks) / sizeof(sched_task_t))
+
+/**Executes all tasks having specified rate
+ * \param d pointer to ECU data structure
+ * \param rate rate of tasks to be executed
+ */
+static void run_tasks(struct ecudata_t* d, uint8_t rate)
+{
+ uint8_t i = 0;
+ for(; i < SCHED_TASKS_NUMBER; ++i)
+ {
+  if (PGM_GET_BYTE(&sched_tasks[i].rate) == rate)
+   ((sched_pfn_task)PGM_GET_WORD(&sched_tasks[i].task))(d);
+ }
+}
+
+void sched_init(void)
+{
+ sched.last_tick = s_timer_gtc();
+ sched.divider = SCHED_100MS_DIVIDER;
+}
+
+void sched_run_timed(struct ecudata_t* d)
+{
+ uint16_t tick = s_timer_gtc();
+ if (tick == sched.last_tick)
+  return; //time has not come yet
+ sched.last_tick = tick;
+
+ run_tasks(d, SCHED_RATE_10MS);
+
+ if (--sched.divider == 0)
+ {
+  sched.divider = SCHED_100MS_DIVIDER;
+  run_tasks(d, SCHED_RATE_100MS);
+ }
+}
+
+void sched_run_stroke(struct ecudata_t* d)
+{
+ run_tasks(d, SCHED_RATE_STROKE);
+}
@@ -0,0 +1,52 @@
+/* SECU-3  - An open source, free engine control unit
+   Copyright (C) 2007 Alexey A. Shabelnikov. Ukraine, Kiev
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+   contacts:
+              http://secu-3.org
+              email: shabelnikov@secu-3.org
+*/
+
+
+/** \file sched.h
+ * \author Alexey A. Shabelnikov
+ * Cooperative scheduler of tasks which are executed from the main loop at declared rates
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <stdint.h>
+
+#define SCHED_RATE_10MS    0   //!< task is executed each 10ms
+#define SCHED_RATE_100MS   1   //!< task is executed each 100ms
+#define SCHED_RATE_STROKE  2   //!< task is executed on each engine stroke
+
+struct ecudata_t;
+
+/**Initialization of the scheduler's state variables */
+void sched_init(void);
+
+/**Executes tasks having 10ms and 100ms rates if their time has come. Must be called from the main loop on each pass
+ * \param d pointer to ECU data structure
+ */
+void sched_run_timed(struct ecudata_t* d);
+
+/**Executes tasks which must be executed on each engine stroke. Must be called when stroke event is serviced
+ * \param d pointer to ECU data structure
+ */
+void sched_run_stroke(struct ecudata_t* d);
+
+#endif //_SCHED_H_
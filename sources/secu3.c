@@ -61,7 +61,9 @@
 #include "measure.h"
 #include "params.h"
 #include "procuart.h"
+#include "profiler.h"
 #include "pwrrelay.h"
+#include "sched.h"
 #include "starter.h"
 #include "suspendop.h"
 #include "tables.h"
@@ -91,9 +93,6 @@ void control_engine_units(struct ecudata_t *d)
  //Starter blocking control
  starter_control(d);
 
- //    ,       
- vent_control(d);
-
 #ifndef CARB_AFR //Carb. AFR control supersede power valve functionality
  //Power valve control
  pwrvalve_control(d);
@@ -107,11 +106,6 @@ void control_engine_units(struct ecudata_t *d)
  //power management
  pwrrelay_control(d);
 
-#if defined(SM_CONTROL) || defined(FUEL_INJECT)
- //choke control
- choke_control(d);
-#endif
-
 #if defined(GD_CONTROL)
  //gas dosator control
  gasdose_control(d);
@@ -124,27 +118,48 @@ void control_engine_units(struct ecudata_t *d)
  intkheat_control(d);
 #endif
 
-#ifdef UNI_OUTPUT
- //Universal programmable output control
- uniout_control(d);
-#endif
-
-#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
- lambda_control(d);
-#endif
-
 #ifdef CARB_AFR
  //Carburetor AFR control
  carbafr_control(d);
 #endif
 }
 
-/** Check firmware integrity (CRC) and set error indication if code or data is damaged
+/**Number of bytes of firmware checked per one pass of the main loop. Full check of 64K part takes
+ * about 2000 passes (a few seconds) */
+#define FWCHECK_CHUNK_SIZE 32
+
+/**State of the background check of firmware integrity */
+typedef struct
+{
+ uint16_t addr;                         //!< address of the next chunk to be checked
+ uint16_t crc;                          //!< running CRC of already checked part of firmware
+}fwcheck_t;
+
+/**Global instance of state variables of the firmware integrity check */
+fwcheck_t fwc = {0, 0xFFFF};
+
+/** Check firmware integrity (CRC) and set error indication if code or data is damaged.
+ * Checks next chunk of firmware, so it must be called on each pass of the main loop. Once whole
+ * firmware has been checked, CRC is compared and check starts again. Thus damage of the flash
+ * is detected not only at startup, but also during operation.
+ * (   ,      )
  */
 void check_firmware_integrity(void)
 {
- if (crc16f(0, CODE_SIZE)!=PGM_GET_WORD(&fw_data.code_crc))
-  ce_set_error(ECUERROR_PROGRAM_CODE_BROKEN);
+ uint16_t size = CODE_SIZE - fwc.addr;
+ if (size > FWCHECK_CHUNK_SIZE)
+  size = FWCHECK_CHUNK_SIZE;
+
+ fwc.crc = crc16f_update_buf((uint8_t _PGM*)fwc.addr, size, fwc.crc);
+ fwc.addr+= size;
+
+ if (fwc.addr >= CODE_SIZE)
+ { //whole firmware has been checked
+  if (fwc.crc != PGM_GET_WORD(&fw_data.code_crc))
+   ce_set_error(ECUERROR_PROGRAM_CODE_BROKEN);
+  fwc.addr = 0;
+  fwc.crc = 0xFFFF;
+ }
 }
 
 /**Initialization of I/O ports
@@ -189,6 +204,60 @@ void init_ports(void)
 #endif
 }
 
+//  ,    .    
+//   .  ,     
+// ,     .
+/**Callback of force_measure_timeout_counter, called from s_timer_dispatch() */
+static void force_measure(void)
+{
+ if (!edat.param.knock_use_knock_channel)
+ {
+  _DISABLE_INTERRUPT();
+  adc_begin_measure(0);  //normal speed
+  _ENABLE_INTERRUPT();
+ }
+ else
+ {
+  //      HIP,     .
+  while(!knock_is_latching_idle());
+  _DISABLE_INTERRUPT();
+  //      20,     (
+  //     ).        ,    
+  // 20-25,        .
+  knock_set_integration_mode(KNOCK_INTMODE_INT);
+  _DELAY_US(22);
+  knock_set_integration_mode(KNOCK_INTMODE_HOLD);
+  adc_begin_measure_all(); //    
+  _ENABLE_INTERRUPT();
+ }
+
+ s_timer_set(force_measure_timeout_counter, FORCE_MEASURE_TIMEOUT_VALUE);
+ meas_update_values_buffers(&edat, 0);
+}
+
+/**Fills stroke command with values calculated in the current pass of main loop and publishes it.
+ * All values will be latched by ISR together at the beginning of the next engine stroke
+ * \param angle advance angle to be applied
+ */
+static void publish_stroke_cmd(int16_t angle)
+{
+ ckps_stroke_cmd_t* p_cmd = ckps_get_stroke_cmd();
+ p_cmd->advance_angle = angle;
+#ifdef DWELL_CONTROL
+#if defined(HALL_SYNC) || defined(CKPS_NPLUS1)
+ //Double dwell time if RPM is low and non-stable
+ p_cmd->acc_time = edat.st_block ? accumulation_time(&edat) : accumulation_time(&edat) << 1;
+#else
+ //calculate accumulation time (dwell control)
+ p_cmd->acc_time = accumulation_time(&edat);
+#endif
+#endif
+#ifdef FUEL_INJECT
+ p_cmd->inj_time = edat.inj_pw; //current injection time
+#endif
+ ckps_publish_stroke_cmd();
+}
+
 /**Initialization of system modules
  */
 void init_modules(void)
@@ -262,17 +331,17 @@ void init_modules(void)
  ckps_set_knock_window(edat.param.knock_k_wnd_begin_angle,edat.param.knock_k_wnd_end_angle);
  ckps_use_knock_channel(edat.param.knock_use_knock_channel);
  ckps_set_cogs_btdc(edat.param.ckps_cogs_btdc); //<--now valid initialization
+ ckps_set_map_window(PGM_GET_WORD(&fw_data.exdata.map_wnd_begin), PGM_GET_WORD(&fw_data.exdata.map_wnd_width));
  ckps_set_merge_outs(edat.param.merge_ign_outs);
 #ifdef HALL_OUTPUT
  ckps_set_hall_pulse(edat.param.hop_start_cogs, edat.param.hop_durat_cogs);
 #endif
 #if defined(HALL_SYNC) || defined(CKPS_NPLUS1)
  ckps_set_shutter_wnd_width(edat.param.hall_wnd_width);
- ckps_set_advance_angle(0);
 #endif
 
 #ifdef FUEL_INJECT
- ckps_set_inj_timing(edat.param.inj_timing_crk); //use inj.timing on cranking
+ ckps_set_inj_timing(edat.param.inj_timing_crk, CHECKBIT(edat.param.inj_flags, INJFLG_ENDOFPULSE)); //use inj.timing on cranking
  inject_init_state();
  inject_set_cyl_number(edat.param.ckps_engine_cyl);
  inject_set_num_squirts(edat.param.inj_config & 0xF);
@@ -288,6 +357,9 @@ void init_modules(void)
 #endif
 
  s_timer_init();
+ s_timer_set_cb(force_measure_timeout_counter, force_measure);
+ s_timer_set(force_measure_timeout_counter, FORCE_MEASURE_TIMEOUT_VALUE);
+ sched_init();
  ignlogic_init();
 
  vent_init_state();
@@ -301,6 +373,8 @@ void init_modules(void)
 
  //       
  meas_initial_measure(&edat);
+ operating_point_init();
+ calc_operating_point(&edat);
 }
 
 /**Main function of firmware - entry point. Contains initialization and main loop 
@@ -324,9 +398,6 @@ MAIN()
  //Perform I/O ports configuration/initialization (  /)
  init_ports();
 
- //If firmware code is damaged then turn on CE (    -  )
- check_firmware_integrity();
-
  //Start watchdog timer! (  )
  wdt_start_timer();
 
@@ -353,6 +424,11 @@ MAIN()
  //------------------------------------------------------------------------
  while(1)
  {
+  LOOPPROF_BEGIN();
+
+  //check deadlines of virtual timers and call callbacks of expired ones
+  s_timer_dispatch();
+
   if (ckps_is_cog_changed())
    s_timer_set(engine_rotation_timeout_counter, ENGINE_ROTATION_TIMEOUT_VALUE);
 
@@ -372,56 +448,34 @@ MAIN()
     knock_start_settings_latching();
 
    edat.corr.curr_angle = calc_adv_ang;
+   publish_stroke_cmd(0);                 //zero advance angle until first stroke, but keep dwell up to date
    meas_update_values_buffers(&edat, 1);  //<-- update RPM only
   }
 
-  //  ,    .    
-  //   .  ,     
-  // ,     .
-  if (s_timer_is_action(force_measure_timeout_counter))
-  {
-   if (!edat.param.knock_use_knock_channel)
-   {
-    _DISABLE_INTERRUPT();
-    adc_begin_measure(0);  //normal speed
-    _ENABLE_INTERRUPT();
-   }
-   else
-   {
-    //      HIP,     .
-    while(!knock_is_latching_idle());
-    _DISABLE_INTERRUPT();
-    //      20,     (
-    //     ).        ,    
-    // 20-25,        .
-    knock_set_integration_mode(KNOCK_INTMODE_INT);
-    _DELAY_US(22);
-    knock_set_integration_mode(KNOCK_INTMODE_HOLD);
-    adc_begin_measure_all(); //    
-    _ENABLE_INTERRUPT();
-   }
-
-   s_timer_set(force_measure_timeout_counter, FORCE_MEASURE_TIMEOUT_VALUE);
-   meas_update_values_buffers(&edat, 0);
-  }
+  LOOPPROF_STAGE(LPSTAGE_TIMERS);
 
   //---------- -----------------------------------------
   //  
   sop_execute_operations(&edat);
-  //     
-  ce_check_engine(&edat, &ce_control_time_counter);
+  LOOPPROF_STAGE(LPSTAGE_SOP);
   // /   
   process_uart_interface(&edat);
-  //  
-  save_param_if_need(&edat);
+  LOOPPROF_STAGE(LPSTAGE_UART);
   //    
   edat.sens.inst_frq = ckps_calculate_instant_freq();
   //      
   meas_average_measured_values(&edat);
+  //interpolation nodes on RPM and MAP axes for all lookup tables
+  calc_operating_point(&edat);
   //c       
   meas_take_discrete_inputs(&edat);
+  LOOPPROF_STAGE(LPSTAGE_MEAS);
   // 
   control_engine_units(&edat);
+  LOOPPROF_STAGE(LPSTAGE_UNITS);
+  //execution of tasks having 10ms and 100ms rates (CE, cooling fan, choke, saving of parameters etc)
+  sched_run_timed(&edat);
+  LOOPPROF_STAGE(LPSTAGE_SCHED);
   //   (  -   )
   calc_adv_ang = ignlogic_system_state_machine(&edat);
   //   -
@@ -435,15 +489,6 @@ MAIN()
   if (edat.param.zero_adv_ang)
    calc_adv_ang = 0;
 
-#ifdef DWELL_CONTROL
-#if defined(HALL_SYNC) || defined(CKPS_NPLUS1)
-  //Double dwell time if RPM is low and non-stable
-  ckps_set_acc_time(edat.st_block ? accumulation_time(&edat) : accumulation_time(&edat) << 1);
-#else
-  //calculate and update accumulation time (dwell control)
-  ckps_set_acc_time(accumulation_time(&edat));
-#endif
-#endif
   if (edat.sys_locked)
    ckps_enable_ignition(0);
   else
@@ -458,12 +503,14 @@ MAIN()
 #ifdef DIAGNOSTICS
   diagnost_process(&edat);
 #endif
+  LOOPPROF_STAGE(LPSTAGE_IGNLOGIC);
   //------------------------------------------------------------------------
 
 
   //         .
   if (ckps_is_stroke_event_r())
   {
+   LOOPPROF_STROKE(edat.sens.inst_frq, edat.param.ckps_engine_cyl);
    meas_update_values_buffers(&edat, 0);
    s_timer_set(force_measure_timeout_counter, FORCE_MEASURE_TIMEOUT_VALUE);
 
@@ -497,12 +544,14 @@ MAIN()
     edat.corr.knock_retard = 0;
    //----------------------------------------------
 
-   //         
-   ckps_set_advance_angle(edat.corr.curr_angle);
+   // ,            
+   publish_stroke_cmd(edat.corr.curr_angle);
+
+   //binary datalog frame (if datalog mode is active and frames are sent on each stroke)
+   process_uart_stroke(&edat);
 
 #ifdef FUEL_INJECT
-   //set current injection time and fuel cut state
-   inject_set_inj_time(edat.inj_pw);
+   //set current fuel cut state
 #ifdef GD_CONTROL
    //enable/disable fuel supply depending on fuel cut, rev.lim, sys.lock flags. Also fuel supply will be disabled if fuel type is gas and gas doser is activated
    inject_set_fuelcut(edat.ie_valve && !edat.sys_locked && !edat.fc_revlim && !(edat.sens.gas && (IOCFG_CHECK(IOP_GD_STP) || CHECKBIT(edat.param.flpmp_flags, FPF_INJONGAS))));
@@ -510,17 +559,10 @@ MAIN()
    inject_set_fuelcut(edat.ie_valve && !edat.sys_locked && !edat.fc_revlim && !(edat.sens.gas && CHECKBIT(edat.param.flpmp_flags, FPF_INJONGAS)));
 #endif
    //set injection timing depending on current mode of engine
-   ckps_set_inj_timing(edat.corr.inj_timing);
-#endif
-#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
-   lambda_stroke_event_notification(&edat);
-#endif
-
-   ignlogic_stroke_event_notification(&edat);
-
-#ifdef GD_CONTROL
-   gasdose_stroke_event_notification(&edat);
+   ckps_set_inj_timing(edat.corr.inj_timing, CHECKBIT(edat.param.inj_flags, INJFLG_ENDOFPULSE));
 #endif
+   //execution of tasks which must be notified about each stroke
+   sched_run_stroke(&edat);
 
    //      
    if (edat.param.knock_use_knock_channel)
@@ -535,8 +577,15 @@ MAIN()
    }
    if (turnout_low_priority_errors_counter > 0)
     turnout_low_priority_errors_counter--;
+   LOOPPROF_STAGE(LPSTAGE_STROKE);
   }
 
+  //If firmware code is damaged then turn on CE (    -  ).
+  //Firmware is checked by small chunks, so startup is not delayed
+  check_firmware_integrity();
+  LOOPPROF_STAGE(LPSTAGE_FWCHECK);
+
+  LOOPPROF_END();
   wdt_reset_timer();
  }//main loop
  //------------------------------------------------------------------------
@@ -277,8 +277,8 @@ void sop_execute_operations(struct ecudata_t* d)
  }
  if (sop_is_operation_active(SOP_SEND_NC_LEAVE_DIAG))
  {
-  //Is sender busy ( )?
-  if (!uart_is_sender_busy())
+  //all previous packets must be sent before reset
+  if (uart_is_sender_idle())
   {
    _AB(d->op_comp_code, 0) = OPCODE_DIAGNOST_LEAVE;
    uart_send_packet(d, OP_COMP_NC);    //    
@@ -290,8 +290,8 @@ void sop_execute_operations(struct ecudata_t* d)
 
  if (sop_is_operation_active(SOP_SEND_NC_RESET_EEPROM))
  {
-  // ?
-  if (!uart_is_sender_busy())
+  //all previous packets must be sent before reset
+  if (uart_is_sender_idle())
   {
    _AB(d->op_comp_code, 0) = OPCODE_RESET_EEPROM;
    _AB(d->op_comp_code, 1) = 0x55;
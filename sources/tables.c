@@ -192,7 +192,7 @@ PGM_FIXED_ADDR_OBJ(fw_data_t fw_data, ".firmware_data") =
   },
 
   /**32-bit config data*/
-  _CBV32(0/*not used*/, 0) | _CBV32(0/*not used*/, 1) | _CBV32(0/*COPT_ATMEGA64, left for compatibility*/, 2) | _CBV32(0/*COPT_ATMEGA128, left for compatibility*/, 3) |
+  _CBV32(COPT_ISR_PROFILING, 0) | _CBV32(COPT_LOOP_PROFILING, 1) | _CBV32(0/*COPT_ATMEGA64, left for compatibility*/, 2) | _CBV32(0/*COPT_ATMEGA128, left for compatibility*/, 3) |
   _CBV32(0/*not used*/, 4) | _CBV32(0/*not used*/, 5) | _CBV32(0/*not used*/, 6) | _CBV32(COPT_DWELL_CONTROL, 7) |
   _CBV32(COPT_COOLINGFAN_PWM, 8) | _CBV32(COPT_REALTIME_TABLES, 9) | _CBV32(COPT_ICCAVR_COMPILER, 10) | _CBV32(COPT_AVRGCC_COMPILER, 11) |
   _CBV32(COPT_DEBUG_VARIABLES, 12) | _CBV32(COPT_PHASE_SENSOR, 13) | _CBV32(COPT_PHASED_IGNITION, 14) | _CBV32(COPT_FUEL_PUMP, 15) |
@@ -368,6 +368,13 @@ PGM_FIXED_ADDR_OBJ(fw_data_t fw_data, ".firmware_data") =
 
   .load_src_cfg =                0,                    //default is MAP
 
+  //RPM, MAP, voltage, coolant temperature (median against spikes), TPS, ADD_IO1, ADD_IO2, speed, PA4
+  .meas_flt_cfg =                {0, 0, 0, MFLT_CFG(MFLT_MEDIAN5, 0, 0), 0, 0, 0, 0, 0},
+  .meas_flt_slew =               {0},
+
+  .dlog_fields =                 DLOGF_DEFAULT,
+  .dlog_period =                 0,                    //on each stroke
+
   .reserved =                    {0},
   .crc =                         0
  },
@@ -439,6 +446,19 @@ PGM_FIXED_ADDR_OBJ(fw_data_t fw_data, ".firmware_data") =
    {_GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0), _GD(50.0)}  //0%    1
   },
 
+  /**Load grid is not used by default (linear axis between map_lower_pressure and map_upper_pressure)*/
+  {0},
+  {0},
+
+  /**Per-cylinder trim of injection pulse width is not used by default*/
+  {0},
+
+  /**Crank-synchronous sampling of MAP is off by default*/
+  0, 0, MAPWND_AVERAGE,
+
+  /**Default averaging depths of measured values are used*/
+  {0},
+
   /**reserved bytes*/
   {0}
  },
@@ -75,6 +75,7 @@
 #define CHOKE_CLOSING_LOOKUP_TABLE_SIZE 16          //!< Size of lookup table defining choke closing versus coolant temperature
 #define ATS_CORR_LOOKUP_TABLE_SIZE      16          //!< Air temperature sensor advance angle correction lookup table
 #define RPM_GRID_SIZE                   16          //!< Number of points on the RPM axis in advance angle lookup tables
+#define LOAD_GRID_SIZE                  16          //!< Number of points on the load axis in work, VE, AFR and inj.timing lookup tables
 #define IBTN_KEYS_NUM                   2           //!< Number of iButton keys
 #define IBTN_KEY_SIZE                   6           //!< Size of iButton key (except CRC8 and family code)
 
@@ -87,6 +88,8 @@
 #define INJ_AE_TPS_LOOKUP_TABLE_SIZE    8           //!< number of points in AE TPS (d%/dt) lookup table
 #define INJ_AE_RPM_LOOKUP_TABLE_SIZE    4           //!< number of points in AE RPM lookup table size
 #define INJ_AFTSTR_LOOKUP_TABLE_SIZE    16          //!< afterstart enrichment lookup table
+#define INJ_CYL_TRIM_SIZE               8           //!< number of cylinders in the per-cylinder injection trim table
+#define MEAS_AVR_NUMBER                 9           //!< number of averaging buffers of measured values (see meas_avr_depth)
 
 #define UNI_OUTPUT_NUMBER               3           //!< number of universal programmable outputs
 
@@ -119,6 +122,40 @@
 
 //Injection flags (see inj_flags variable)
 #define INJFLG_USETIMINGMAP             0           //!< Use injection timing map instead of simple constant
+#define INJFLG_ENDOFPULSE               1           //!< Injection timing defines end of pulse instead of its beginning
+
+//Modes of crank-synchronous sampling of MAP (see map_wnd_mode variable)
+#define MAPWND_AVERAGE                  0           //!< MAP is average of values measured in the windows of all cylinders
+#define MAPWND_MINIMUM                  1           //!< MAP is average of minimum values measured in the windows of all cylinders
+
+//Configuration of filters of measured values (see meas_flt_cfg variable)
+#define MFLT_MEDIAN_MASK                0x03        //!< Median pre-filter: 0 - off, 1 - 3 taps, 2 - 5 taps
+#define MFLT_MEDIAN3                    0x01        //!< 3-tap median pre-filter
+#define MFLT_MEDIAN5                    0x02        //!< 5-tap median pre-filter
+#define MFLT_IIR                        2           //!< Bit: smoothing by first-order IIR filter instead of boxcar averaging
+#define MFLT_SHIFT(cfg)                 (((cfg) >> 3) & 0x07) //!< log2 of boxcar depth (0 - use meas_avr_depth) or IIR coefficient (y+= (x - y) / 2^shift)
+#define MFLT_CFG(med, iir, shift)       ((med) | ((iir) << MFLT_IIR) | ((shift) << 3)) //!< Builds configuration of filters
+
+//Fields of binary datalog frames (see dlog_fields variable), fields are sent in the order of their bits
+#define DLOGF_RPM                       0           //!< instant RPM (2 bytes)
+#define DLOGF_MAP                       1           //!< MAP (2 bytes)
+#define DLOGF_VOLTAGE                   2           //!< board voltage (2 bytes)
+#define DLOGF_TEMP                      3           //!< coolant temperature (2 bytes)
+#define DLOGF_ANGLE                     4           //!< current advance angle (2 bytes)
+#define DLOGF_KNOCK                     5           //!< knock signal level and knock retard (2 + 2 bytes)
+#define DLOGF_TPS                       6           //!< TPS and its speed (1 + 2 bytes)
+#define DLOGF_ADDI                      7           //!< ADD_I1 and ADD_I2 voltages (2 + 2 bytes)
+#define DLOGF_FLAGS                     8           //!< boolean values, the same as in SENSOR_DAT packet (1 byte)
+#define DLOGF_AALT                      9           //!< advance angles from maps and corrections (7 x 2 bytes)
+#define DLOGF_LAMBDA                    10          //!< lambda correction (2 bytes)
+#define DLOGF_INJ                       11          //!< injection pulse width and injection timing (2 + 2 bytes)
+#define DLOGF_AIRTEMP                   12          //!< intake air temperature (2 bytes)
+#define DLOGF_SPEED                     13          //!< vehicle speed sensor period (2 bytes)
+#define DLOGF_RAW                       14          //!< raw ADC values of MAP, voltage, temperature, TPS, ADD_I1, ADD_I2 (6 x 2 bytes)
+#define DLOGF_NUMBER                    15          //!< number of fields
+/**Default set of fields of datalog frames, it is also used when dlog_fields is 0 (e.g. parameters saved by previous versions) */
+#define DLOGF_DEFAULT                   (_BV(DLOGF_RPM) | _BV(DLOGF_MAP) | _BV(DLOGF_VOLTAGE) | _BV(DLOGF_TEMP) | _BV(DLOGF_ANGLE) | \
+                                         _BV(DLOGF_KNOCK) | _BV(DLOGF_TPS) | _BV(DLOGF_FLAGS))
 
 //Fuel pump flags
 #define FPF_OFFONGAS                    0           //!< Turn off fuel pump when fuel type is gas
@@ -211,10 +248,35 @@ typedef struct fw_ex_data_t
   /** Gas dose actuator position vs (TPS,RPM)*/
   uint8_t gasdose_pos[GASDOSE_POS_TPS_SIZE][GASDOSE_POS_RPM_SIZE];
 
+  /**Points of the load grid (MAP, kPa * MAP_PHYSICAL_MAGNITUDE_MULTIPLIER), in ascending order. The last point
+   * corresponds to the first row of tables. If grid is not filled (any of sizes is zero) or points are not ascending,
+   * then load axis is linear (between map_lower_pressure and map_upper_pressure)*/
+  int16_t load_grid_points[LOAD_GRID_SIZE];
+  /**Sizes of cells in load grid (so, we don't need to calculate them at the runtime)*/
+  int16_t load_grid_sizes[LOAD_GRID_SIZE-1];
+
+  /**Per-cylinder trim of injection pulse width, used in full sequential injection mode. Signed value / 256,
+   * e.g. 13 = +5.1%, -26 = -10.2%. Index is number of cylinder in the firing order */
+  int8_t inj_cyl_trim[INJ_CYL_TRIM_SIZE];
+
+  /**Crank-synchronous sampling of MAP: beginning of the sampling window of each cylinder, in crank degrees
+   * before TDC of compression stroke (0...720) * ANGLE_MULTIPLIER. E.g. 360 corresponds to the beginning of intake stroke */
+  int16_t map_wnd_begin;
+  /**Width of the MAP sampling window in crank degrees * ANGLE_MULTIPLIER. MAP is sampled on each tooth of the
+   * window. 0 - crank-synchronous sampling is off */
+  int16_t map_wnd_width;
+  /**Which value obtained in the windows is used as MAP (see MAPWND_x constants) */
+  uint8_t map_wnd_mode;
+
+  /**Averaging depths of measured values: RPM, MAP, voltage, coolant temperature, TPS, ADD_IO1, ADD_IO2,
+   * speed sensor, PA4. Allowed values are 1, 2, 4, 8 (other values are rounded down to power of 2),
+   * 0 - default depth is used */
+  uint8_t meas_avr_depth[MEAS_AVR_NUMBER];
+
   /**Following reserved bytes required for keeping binary compatibility between
    * different versions of firmware. Useful when you add/remove members to/from
    * this structure. */
-  uint8_t reserved[1792];
+  uint8_t reserved[1708];
 }fw_ex_data_t;
 
 /**Describes a unirersal programmable output*/
@@ -405,17 +467,32 @@ typedef struct params_t
 
   uint8_t  load_src_cfg;                 //!< Engine load source selection (0 - MAP, 1 - TPS)
 
+  /**Filters of measured values: RPM, MAP, voltage, coolant temperature, TPS, ADD_IO1, ADD_IO2, speed sensor, PA4
+   * (see MFLT_x constants). 0 - boxcar averaging with depth from meas_avr_depth (samples of coolant temperature
+   * are also restricted to +/-6.25% of averaged value, as in previous versions) */
+  uint8_t  meas_flt_cfg[MEAS_AVR_NUMBER];
+  /**Slew-rate limits of measured values (same order as in meas_flt_cfg): maximum change of filtered value
+   * per sample, in units of raw value (e.g. ADC discretes). 0 - no limit */
+  uint8_t  meas_flt_slew[MEAS_AVR_NUMBER];
+
+  uint16_t dlog_fields;                  //!< Set of fields sent in binary datalog frames (see DLOGF_x constants), 0 - DLOGF_DEFAULT
+  uint8_t  dlog_period;                  //!< Period of datalog frames in ms (1...200), 0 - frames are sent on each engine stroke
+
   /**Following reserved bytes required for keeping binary compatibility between
    * different versions of firmware. Useful when you add/remove members to/from
    * this structure. */
-  uint8_t  reserved[63];
+  uint8_t  reserved[42];
 
   /**CRC of this structure (for checking correctness of data after loading from EEPROM) */
   uint16_t crc;
 }params_t;
 
 //Define data structures are related to code area data and IO remapping data
+#ifdef HOST_SIM
+typedef uintptr_t fnptr_t;               //!< Special type for function pointers (pointers of the host are wider than 16 bits)
+#else
 typedef uint16_t fnptr_t;                //!< Special type for function pointers
+#endif
 #define IOREM_SLOTS  37                  //!< Number of slots used for I/O remapping
 #define IOREM_PLUGS  68                  //!< Number of plugs used in I/O remapping
 
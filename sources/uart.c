@@ -32,10 +32,12 @@
 #include "port/port.h"
 #include <string.h>
 #include "bitmask.h"
+#include "crc16.h"
 #include "dbgvar.h"
 #include "ecudata.h"
 #include "eeprom.h"
 #include "ioconfig.h"
+#include "profiler.h"
 #include "uart.h"
 #include "ufcodes.h"
 #include "wdt.h"
@@ -68,16 +70,49 @@ uint16_t dbg_var4 = 0;   /**User's debug variable 4*/
 #define ETMT_AFTSTR_MAP 14  //!< afterstart enrichment
 #define ETMT_IT_MAP   15    //!< injection timing map
 
+#ifdef REALTIME_TABLES
+/**Number of blocks in set of tables */
+#define TABBLK_NUM ((sizeof(f_data_t) + TABBLK_SIZE - 1) / TABBLK_SIZE)
+
+/**State of bulk transfer of tables */
+typedef struct
+{
+ uint8_t op;                            //!< pending operation (TBOP_DATA, TBOP_ACK or 0)
+ uint8_t block;                         //!< next block to be sent or block to be acknowledged
+ uint8_t end;                           //!< block following the last block to be sent
+ uint8_t status;                        //!< status of acknowledgement (TBST_x)
+}tabblk_t;
+
+/**State variables of bulk transfer of tables */
+tabblk_t tabblk = {0};
+
+/**Calculates size of specified block of set of tables
+ * \param block number of block
+ * \return size of block in bytes, 0 - wrong number of block
+ */
+static uint8_t tabblk_size(uint8_t block)
+{
+ if (block >= TABBLK_NUM)
+  return 0;
+ return (block == TABBLK_NUM - 1) ? sizeof(f_data_t) - (TABBLK_NUM - 1) * TABBLK_SIZE : TABBLK_SIZE;
+}
+#endif
+
 /**Define internal state variables */
 typedef struct
 {
  uint8_t send_mode;                     //!< current descriptor of packets beeing send
- uint8_t recv_buf[UART_RECV_BUFF_SIZE]; //!< receiver's buffer
- uint8_t send_buf[UART_SEND_BUFF_SIZE]; //!< transmitter's buffer
- volatile uint8_t send_size;            //!< size of data to be send
- uint8_t send_index;                    //!< index in transmitter's buffer
- volatile uint8_t recv_size;            //!< size of received data
- uint8_t recv_index;                    //!< index in receiver's buffer
+ uint8_t recv_queue[UART_RECV_QUEUE_SIZE][UART_RECV_BUFF_SIZE]; //!< receiver's queue of frames
+ uint8_t recv_qsize[UART_RECV_QUEUE_SIZE]; //!< sizes of frames in the receiver's queue
+ volatile uint8_t recv_head;            //!< counter of received frames (ISR only)
+ volatile uint8_t recv_tail;            //!< counter of processed frames (main loop only)
+ uint8_t* recv_buf;                     //!< frame being processed (entry of the receiver's queue)
+ uint8_t send_buf[UART_SEND_BUFF_SIZE]; //!< transmitter's ring buffer
+ uint8_t send_head;                     //!< index of the next byte to be written into the ring buffer (main loop only)
+ volatile uint8_t send_end;             //!< end of data committed for transmission by uart_begin_send()
+ volatile uint8_t send_tail;            //!< index of the next byte to be transmitted (ISR only)
+ uint8_t recv_size;                     //!< size of frame being processed
+ uint8_t recv_index;                    //!< index in frame being processed
 }uartstate_t;
 
 /**State variables */
@@ -103,21 +138,21 @@ void append_tx_buff(uint8_t b)
 {
  if (b == FOBEGIN)
  {
-  uart.send_buf[uart.send_size++] = FESC;
-  uart.send_buf[uart.send_size++] = TFOBEGIN;
+  uart.send_buf[uart.send_head++] = FESC;
+  uart.send_buf[uart.send_head++] = TFOBEGIN;
  }
  else if ((b) == FIOEND)
  {
-  uart.send_buf[uart.send_size++] = FESC;
-  uart.send_buf[uart.send_size++] = TFIOEND;
+  uart.send_buf[uart.send_head++] = FESC;
+  uart.send_buf[uart.send_head++] = TFIOEND;
  }
  else if ((b) == FESC)
  {
-  uart.send_buf[uart.send_size++] = FESC;
-  uart.send_buf[uart.send_size++] = TFESC;
+  uart.send_buf[uart.send_head++] = FESC;
+  uart.send_buf[uart.send_head++] = TFESC;
  }
  else
-  uart.send_buf[uart.send_size++] = b;
+  uart.send_buf[uart.send_head++] = b;
 }
 
 /** Takes out byte from receiver's buffer
@@ -161,8 +196,7 @@ void build_fs(uint8_t _PGM *romBuffer, uint8_t size)
 #ifdef UART_BINARY
  while(size--) append_tx_buff(PGM_GET_BYTE(romBuffer++));
 #else
- memcpy_P(&uart.send_buf[uart.send_size], romBuffer, size);
- uart.send_size+=size;
+ while(size--) uart.send_buf[uart.send_head++] = PGM_GET_BYTE(romBuffer++);
 #endif
 }
 
@@ -173,8 +207,7 @@ void build_rs(const uint8_t* ramBuffer, uint8_t size)
 #ifdef UART_BINARY
  while(size--) append_tx_buff(*ramBuffer++);
 #else
- memcpy(&uart.send_buf[uart.send_size], ramBuffer, size);
- uart.send_size+=size;
+ while(size--) uart.send_buf[uart.send_head++] = *ramBuffer++;
 #endif
 }
 
@@ -184,7 +217,7 @@ void build_rs(const uint8_t* ramBuffer, uint8_t size)
 #else
 static void build_i4h(uint8_t i)
 {
- uart.send_buf[uart.send_size++] = (i < 0xA) ? i+0x30 : i+0x37;
+ uart.send_buf[uart.send_head++] = (i < 0xA) ? i+0x30 : i+0x37;
 }
 #endif
 
@@ -196,8 +229,8 @@ static void build_i8h(uint8_t i)
 #ifdef UART_BINARY
  append_tx_buff(i);           //1 
 #else
- uart.send_buf[uart.send_size++] = PGM_GET_BYTE(&hdig[i/16]);          //  HEX 
- uart.send_buf[uart.send_size++] = PGM_GET_BYTE(&hdig[i%16]);          //  HEX 
+ uart.send_buf[uart.send_head++] = PGM_GET_BYTE(&hdig[i/16]);          //  HEX 
+ uart.send_buf[uart.send_head++] = PGM_GET_BYTE(&hdig[i%16]);          //  HEX 
 #endif
 }
 
@@ -210,19 +243,13 @@ static void build_i16h(uint16_t i)
  append_tx_buff(_AB(i,1));    // 
  append_tx_buff(_AB(i,0));    // 
 #else
- uart.send_buf[uart.send_size++] = PGM_GET_BYTE(&hdig[_AB(i,1)/16]);   //  HEX  ( )
- uart.send_buf[uart.send_size++] = PGM_GET_BYTE(&hdig[_AB(i,1)%16]);   //  HEX  ( )
- uart.send_buf[uart.send_size++] = PGM_GET_BYTE(&hdig[_AB(i,0)/16]);   //  HEX  ( )
- uart.send_buf[uart.send_size++] = PGM_GET_BYTE(&hdig[_AB(i,0)%16]);   //  HEX  ( )
+ uart.send_buf[uart.send_head++] = PGM_GET_BYTE(&hdig[_AB(i,1)/16]);   //  HEX  ( )
+ uart.send_buf[uart.send_head++] = PGM_GET_BYTE(&hdig[_AB(i,1)%16]);   //  HEX  ( )
+ uart.send_buf[uart.send_head++] = PGM_GET_BYTE(&hdig[_AB(i,0)/16]);   //  HEX  ( )
+ uart.send_buf[uart.send_head++] = PGM_GET_BYTE(&hdig[_AB(i,0)%16]);   //  HEX  ( )
 #endif
 }
 
-static void build_i24h(uint32_t i)
-{
- build_i8h(i>>16);
- build_i16h(i);
-}
-
 /**Appends sender's buffer by 8 HEX bytes
  * \param i 32-bit value to be converted into hex
  */
@@ -256,6 +283,164 @@ static void build_rw(const uint16_t* ramBuffer, uint8_t size)
  while(size--) build_i16h(*ramBuffer++);
 }
 
+/**CRC16 of data appended by build_raw8() and build_raw16() (used for binary datalog frames) */
+static uint16_t raw_crc;
+
+/**Appends sender's buffer by 8-bit value without any encoding and updates raw_crc
+ * \param i 8-bit value
+ */
+static void build_raw8(uint8_t i)
+{
+ uart.send_buf[uart.send_head++] = i;
+ raw_crc = crc16_update(i, raw_crc);
+}
+
+/**Appends sender's buffer by 16-bit value without any encoding and updates raw_crc
+ * \param i 16-bit value
+ */
+static void build_raw16(uint16_t i)
+{
+ build_raw8(_AB(i,1));    // 
+ build_raw8(_AB(i,0));    // 
+}
+
+/**Collects boolean values into one byte (used in SENSOR_DAT packet and datalog frames)
+ * \param d pointer to ECU data structure
+ * \return bits of boolean values
+ */
+static uint8_t get_sensor_flags(struct ecudata_t* d)
+{
+ return (d->ie_valve   << 0) |        // IE flag
+        (d->sens.carb  << 1) |        // carb. limit switch flag
+        (d->sens.gas   << 2) |        // gas valve flag
+        (d->fe_valve   << 3) |        // power valve flag
+        (d->ce_state   << 4) |        // CE flag
+        (d->cool_fan   << 5) |        // cooling fan flag
+        (d->st_block   << 6) |        // starter blocking flag
+#if defined(FUEL_INJECT) || defined(GD_CONTROL)
+        (d->acceleration << 7);       // acceleration enrichment flag
+#else
+        (0 << 7);
+#endif
+}
+
+/**Number of fields in the SENSOR_DAT packet (distance is transferred as two fields: 8 and 16 bits) */
+#define SDF_NUMBER 29
+
+/**Each SDELTA_KEY_PERIOD-th packet in the SENDLT_DAT mode is a full SENSOR_DAT packet (keyframe) */
+#define SDELTA_KEY_PERIOD 25
+
+/**Sizes of fields of the SENSOR_DAT packet in bytes */
+PGM_DECLARE(uint8_t sdf_size[SDF_NUMBER]) = {2,2,2,2,2,2,2,1,1,1,2,2,2,1,1,2,1,2,2,2,2,2,2,2,2,2,2,2,2};
+/**Total size of fields of the SENSOR_DAT packet in bytes (sum of sdf_size), used for checking of buffer's size */
+#define SDF_BYTES 52
+
+/**State of delta-compressed sending of sensors' data (SENDLT_DAT) */
+struct
+{
+ uint16_t prev[SDF_NUMBER];             //!< values of fields which have been sent last time (state of the PC's side)
+ uint8_t cnt;                           //!< number of delta packets left until next keyframe
+}sdelta;
+
+/**Collects values of fields of the SENSOR_DAT packet
+ * \param d pointer to ECU data structure
+ * \param v array of SDF_NUMBER values to be filled
+ */
+static void get_sensor_fields(struct ecudata_t* d, uint16_t* v)
+{
+#ifdef SEND_INST_VAL
+ *v++ = d->sens.inst_frq;             // instant RPM
+#else
+ *v++ = d->sens.frequen;              // averaged RPM
+#endif
+#ifdef SEND_INST_VAL
+ *v++ = d->sens.inst_map;             // instant MAP pressure
+#else
+ *v++ = d->sens.map;                  // averaged MAP pressure
+#endif
+#ifdef SEND_INST_VAL
+ *v++ = d->sens.inst_voltage;         // instant voltage value
+#else
+ *v++ = d->sens.voltage;              // voltage (avaraged)
+#endif
+ *v++ = d->sens.temperat;             // coolant temperature
+ *v++ = d->corr.curr_angle;           // advance angle
+ *v++ = d->sens.knock_k;              // knock value
+ *v++ = d->corr.knock_retard;         // knock retard
+ *v++ = d->airflow;                   // index of the map axis curve
+ *v++ = get_sensor_flags(d);          //boolean values
+ *v++ = d->sens.tps;                  // TPS (0...100%, x2)
+#ifdef SEND_INST_VAL
+ *v++ = d->sens.inst_add_i1;          // instant ADD_I1 voltage
+#else
+ *v++ = d->sens.add_i1;               // averaged ADD_I1 voltage
+#endif
+ *v++ = d->sens.add_i2;               // ADD_I2 voltage
+ *v++ = d->ecuerrors_for_transfer;    // CE errors
+ *v++ = d->choke_pos;                 // choke position
+ *v++ = d->gasdose_pos;               // gas dosator position
+#ifdef SPEED_SENSOR
+ *v++ = d->sens.speed;                // vehicle speed (2 bytes)
+ *v++ = d->sens.distance >> 16;       // distance (3 bytes)
+ *v++ = d->sens.distance;
+#else
+ *v++ = 0;
+ *v++ = 0;
+ *v++ = 0;
+#endif
+#ifdef AIRTEMP_SENS
+ if (IOCFG_CHECK(IOP_AIR_TEMP))
+  *v++ = d->sens.air_temp;
+ else
+  *v++ = 0x7FFF;                      //<--indicates that it is not used, voltage will be shown on the dashboard
+#else
+ *v++ = 0;
+#endif
+
+ //corrections
+ *v++ = d->corr.strt_aalt;            // advance angle from start map
+ *v++ = d->corr.idle_aalt;            // advance angle from idle map
+ *v++ = d->corr.work_aalt;            // advance angle from work map
+ *v++ = d->corr.temp_aalt;            // advance angle from coolant temperature correction map
+ *v++ = d->corr.airt_aalt;            // advance angle from air temperature correction map
+ *v++ = d->corr.idlreg_aac;           // advance angle correction from idling RPM regulator
+ *v++ = d->corr.octan_aac
+#ifdef PA4_INP_IGNTIM
+ + d->corr.pa4_aac
+#endif
+ ;        // octane correction value
+
+#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
+ *v++ = d->corr.lambda;               // lambda correction
+#else
+ *v++ = 0;
+#endif
+
+#ifdef FUEL_INJECT
+ *v++ = d->inj_pw;                    // injector pulse width
+#else
+ *v++ = 0;
+#endif
+
+#if defined(FUEL_INJECT) || defined(GD_CONTROL)
+ *v++ = d->sens.tpsdot;               // TPS opening/closing speed
+#else
+ *v++ = 0;
+#endif
+}
+
+/**Appends sender's buffer by field of the SENSOR_DAT packet
+ * \param i index of field
+ * \param value value of field
+ */
+static void build_sdf(uint8_t i, uint16_t value)
+{
+ if (1==PGM_GET_BYTE(&sdf_size[i]))
+  build_i8h(value);
+ else
+  build_i16h(value);
+}
+
 //----------    ---------
 /**Recepts sequence of bytes from receiver's buffer and places it into the RAM buffer
  * can NOT be used for binary data */
@@ -349,11 +534,11 @@ static void recept_rw(uint16_t* ramBuffer, uint8_t size)
 
 //--------------------------------------------------------------------
 
-/**Makes sender to start sending */
+/**Makes sender to start sending of data appended to the ring buffer since previous call */
 void uart_begin_send(void)
 {
- uart.send_index = 0;
  _DISABLE_INTERRUPT();
+ uart.send_end = uart.send_head;
  UCSRB |= _BV(UDRIE); /* enable UDRE interrupt */
  _ENABLE_INTERRUPT();
 }
@@ -362,15 +547,19 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
 {
  static uint8_t index = 0;
 
- //     ,       
- uart.send_size = 0;
-
  if (send_mode==0) //  
   send_mode = uart.send_mode;
 
+ if (SENDLT_DAT==send_mode)
+ { //each N-th packet is full SENSOR_DAT packet (keyframe), so PC can restore its state after lost packets
+  if (0==sdelta.cnt)
+   send_mode = SENSOR_DAT, sdelta.cnt = SDELTA_KEY_PERIOD;
+  --sdelta.cnt;
+ }
+
  //    
- uart.send_buf[uart.send_size++] = '@';
- uart.send_buf[uart.send_size++] = send_mode;
+ uart.send_buf[uart.send_head++] = '@';
+ uart.send_buf[uart.send_head++] = send_mode;
 
  switch(send_mode)
  {
@@ -452,9 +641,10 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
    {
     if (eeprom_is_idle())
     {
+     uint8_t name[F_NAME_SIZE];
      build_i8h(index);
-     eeprom_read(&uart.send_buf[uart.send_size], (uint16_t)((f_data_t*)(EEPROM_REALTIME_TABLES_START))->name, F_NAME_SIZE);
-     uart.send_size+=F_NAME_SIZE;
+     eeprom_read(name, (uint16_t)((f_data_t*)(EEPROM_REALTIME_TABLES_START))->name, F_NAME_SIZE);
+     build_rs(name, F_NAME_SIZE);
     }
     else //skip this item - will be transferred next time
     {
@@ -472,97 +662,37 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
     break;
 
   case SENSOR_DAT:
-#ifdef SEND_INST_VAL
-   build_i16h(d->sens.inst_frq);          // instant RPM
-#else
-   build_i16h(d->sens.frequen);           // averaged RPM
-#endif
-#ifdef SEND_INST_VAL
-   build_i16h(d->sens.inst_map);          // instant MAP pressure
-#else
-   build_i16h(d->sens.map);               // averaged MAP pressure
-#endif
-#ifdef SEND_INST_VAL
-   build_i16h(d->sens.inst_voltage);      // instant voltage value
-#else
-   build_i16h(d->sens.voltage);           // voltage (avaraged)
-#endif
-   build_i16h(d->sens.temperat);          // coolant temperature
-   build_i16h(d->corr.curr_angle);        // advance angle
-   build_i16h(d->sens.knock_k);           // knock value
-   build_i16h(d->corr.knock_retard);      // knock retard
-   build_i8h(d->airflow);                 // index of the map axis curve
-   //boolean values
-   build_i8h((d->ie_valve   << 0) |       // IE flag
-             (d->sens.carb  << 1) |       // carb. limit switch flag
-             (d->sens.gas   << 2) |       // gas valve flag
-             (d->fe_valve   << 3) |       // power valve flag
-             (d->ce_state   << 4) |       // CE flag
-             (d->cool_fan   << 5) |       // cooling fan flag
-             (d->st_block   << 6) |       // starter blocking flag
-#if defined(FUEL_INJECT) || defined(GD_CONTROL)
-             (d->acceleration << 7));     // acceleration enrichment flag
-#else
-             (0 << 7));
-#endif
-   build_i8h(d->sens.tps);                // TPS (0...100%, x2)
-#ifdef SEND_INST_VAL
-   build_i16h(d->sens.inst_add_i1);       // instant ADD_I1 voltage
-#else
-   build_i16h(d->sens.add_i1);            // averaged ADD_I1 voltage
-#endif
-   build_i16h(d->sens.add_i2);            // ADD_I2 voltage
-   build_i16h(d->ecuerrors_for_transfer); // CE errors
-   build_i8h(d->choke_pos);               // choke position
-   build_i8h(d->gasdose_pos);             // gas dosator position
-#ifdef SPEED_SENSOR
-   build_i16h(d->sens.speed);             // vehicle speed (2 bytes)
-   build_i24h(d->sens.distance);          // distance (3 bytes)
-#else
-   build_i16h(0);
-   build_i24h(0);
-#endif
-#ifdef AIRTEMP_SENS
-   if (IOCFG_CHECK(IOP_AIR_TEMP))
-    build_i16h(d->sens.air_temp);
-   else
-    build_i16h(0x7FFF);                   //<--indicates that it is not used, voltage will be shown on the dashboard
-#else
-   build_i16h(0);
-#endif
-
-   //corrections
-   build_i16h(d->corr.strt_aalt);         // advance angle from start map
-   build_i16h(d->corr.idle_aalt);         // advance angle from idle map
-   build_i16h(d->corr.work_aalt);         // advance angle from work map
-   build_i16h(d->corr.temp_aalt);         // advance angle from coolant temperature correction map
-   build_i16h(d->corr.airt_aalt);         // advance angle from air temperature correction map
-   build_i16h(d->corr.idlreg_aac);        // advance angle correction from idling RPM regulator
-   build_i16h(d->corr.octan_aac
-#ifdef PA4_INP_IGNTIM
-   + d->corr.pa4_aac
-#endif
-                               );         // octane correction value
-
-#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
-   build_i16h(d->corr.lambda);            // lambda correction
-#else
-   build_i16h(0);
-#endif
-
-#ifdef FUEL_INJECT
-   build_i16h(d->inj_pw);                 // injector pulse width
-#else
-   build_i16h(0);
-#endif
+  {
+   uint16_t v[SDF_NUMBER];
+   uint8_t i = 0;
+   get_sensor_fields(d, v);
+   for(; i < SDF_NUMBER; ++i)
+    build_sdf(i, v[i]);
+   memcpy(sdelta.prev, v, sizeof(v));   //state of the PC's side is refreshed by each full packet
+   break;
+  }
 
-#if defined(FUEL_INJECT) || defined(GD_CONTROL)
-   build_i16h(d->sens.tpsdot);            // TPS opening/closing speed
-#else
-   build_i16h(0);
+  case SENDLT_DAT:
+  { //only fields which have been changed since previous packet
+#if (UART_SEND_PACKET_MAX < 3 + 8 + (SDF_BYTES * 2))
+ #error "Out of buffer!"
 #endif
-
+   uint16_t v[SDF_NUMBER];
+   uint32_t mask = 0;
+   uint8_t i = 0;
+   get_sensor_fields(d, v);
+   for(; i < SDF_NUMBER; ++i)
+    if (v[i] != sdelta.prev[i])
+     mask|= _BV32(i);
+   build_i32h(mask);
+   for(i = 0; i < SDF_NUMBER; ++i)
+    if (mask & _BV32(i))
+    {
+     build_sdf(i, v[i]);
+     sdelta.prev[i] = v[i];
+    }
    break;
+  }
 
   case ADCCOR_PAR:
    build_i16h(d->param.map_adc_factor);
@@ -631,7 +761,7 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
 
   case FWINFO_DAT:
    //  ,       . 3  -    .
-#if ((UART_SEND_BUFF_SIZE - 3) < FW_SIGNATURE_INFO_SIZE+8)
+#if (UART_SEND_PACKET_MAX < 3 + (FW_SIGNATURE_INFO_SIZE * 2) + 8 + 2)
  #error "Out of buffer!"
 #endif
    build_fs(fw_data.fw_signature_info, FW_SIGNATURE_INFO_SIZE);
@@ -737,6 +867,16 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
   break;
 #endif
 
+  case DLOG_PAR:
+   build_i16h(d->param.dlog_fields);
+   build_i8h(d->param.dlog_period);
+   break;
+
+  case MFLT_PAR:
+   build_rb(d->param.meas_flt_cfg, MEAS_AVR_NUMBER);
+   build_rb(d->param.meas_flt_slew, MEAS_AVR_NUMBER);
+   break;
+
 #ifdef REALTIME_TABLES
 //Following finite state machine will transfer all table's data
   case EDITAB_PAR:
@@ -868,6 +1008,29 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
    break;
   }
 
+  //Bulk transfer of set of tables
+  case TABBLK_PAR:
+#if (UART_SEND_PACKET_MAX < 3 + 4 + (TABBLK_SIZE * 2) + 4)
+ #error "Out of buffer!"
+#endif
+   build_i8h(tabblk.op);
+   build_i8h(tabblk.block);
+   if (TBOP_DATA == tabblk.op)
+   {
+    uint8_t* p = ((uint8_t*)&d->tables_ram) + (tabblk.block * TABBLK_SIZE);
+    uint8_t size = tabblk_size(tabblk.block);
+    build_rb(p, size);
+    build_i16h(crc16(p, size));
+    if (++tabblk.block >= tabblk.end)
+     tabblk.op = 0;                     //all requested blocks have been sent
+   }
+   else //TBOP_ACK
+   {
+    build_i8h(tabblk.status);
+    tabblk.op = 0;
+   }
+   break;
+
   //Transferring of RPM grid
   case RPMGRD_PAR:
    build_i8h(0); //<--reserved
@@ -899,6 +1062,35 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
    build_i16h(dbg_var4);
    break;
 #endif
+#ifdef ISR_PROFILING
+  case ISRPRF_DAT:
+  {
+   uint8_t i = 0;
+   for(; i < ISRPROF_NUMBER; ++i)
+   {
+    isrprof_t stat;
+    isrprof_take(i, &stat);   //statistics will be reset after taking
+    build_i16h(stat.count);
+    build_i16h(stat.count ? stat.min : 0);
+    build_i16h(stat.max);
+    build_i16h(stat.count ? (stat.sum / stat.count) : 0); //average
+   }
+   break;
+  }
+#endif
+#ifdef LOOP_PROFILING
+  case LOOPPRF_DAT:
+  {
+   loopprof_t stat;
+   loopprof_take(&stat);      //statistics will be reset after taking
+   build_rw(stat.hist, LOOPPROF_HIST_SIZE);
+   build_i16h(stat.max_time);
+   build_i8h(stat.max_stage);
+   build_i16h(stat.strokes);
+   build_i16h(stat.late_strokes);
+   break;
+  }
+#endif
 #ifdef DIAGNOSTICS
   case DIAGINP_DAT:
    build_i16h(d->diag_inp.voltage);
@@ -915,12 +1107,340 @@ void uart_send_packet(struct ecudata_t* d, uint8_t send_mode)
  }//switch
 
  //    
- uart.send_buf[uart.send_size++] = '\r';
+ uart.send_buf[uart.send_head++] = '\r';
 
  //      -  
  uart_begin_send();
 }
 
+/**Sync byte of binary datalog frames*/
+#define DLOG_SYNC 0xA5
+
+/**Sizes of fields of binary datalog frame in bytes (indexed by DLOGF_x) */
+PGM_DECLARE(uint8_t dlog_fsize[DLOGF_NUMBER]) = {2, 2, 2, 2, 2, 4, 3, 4, 1, 14, 2, 4, 2, 2, 12};
+/**Total size of all fields of binary datalog frame in bytes (sum of dlog_fsize) */
+#define DLOGF_BYTES 58
+
+//frame with all fields must fit into the transmitter's buffer: sync byte, length, header (5), fields and CRC
+#if (UART_SEND_PACKET_MAX < 2 + 5 + DLOGF_BYTES + 2)
+ #error "Out of buffer!"
+#endif
+
+void uart_send_dlog_frame(struct ecudata_t* d)
+{
+ static uint8_t seq = 0;
+ uint16_t fields = d->param.dlog_fields ? d->param.dlog_fields : DLOGF_DEFAULT, t;
+ uint8_t i, len = 5;                          //sequence number, time stamp and mask of fields
+
+ _BEGIN_ATOMIC_BLOCK();
+ t = TCNT1;
+ _END_ATOMIC_BLOCK();
+
+ //frame is appended to the ring buffer, so length is calculated beforehand and CRC is updated on the fly
+ for(i = 0; i < DLOGF_NUMBER; ++i)
+  if (CHECKBIT(fields, i))
+   len+= PGM_GET_BYTE(&dlog_fsize[i]);
+
+ uart.send_buf[uart.send_head++] = DLOG_SYNC;
+ raw_crc = 0xFFFF;
+ build_raw8(len);
+ build_raw8(seq++);                           //sequence number, allows to detect lost frames
+ build_raw16(t);                              //time stamp, 1 tick = 3.2us
+ build_raw16(fields);
+
+ if (CHECKBIT(fields, DLOGF_RPM))
+  build_raw16(d->sens.inst_frq);
+ if (CHECKBIT(fields, DLOGF_MAP))
+  build_raw16(d->sens.map);
+ if (CHECKBIT(fields, DLOGF_VOLTAGE))
+  build_raw16(d->sens.voltage);
+ if (CHECKBIT(fields, DLOGF_TEMP))
+  build_raw16(d->sens.temperat);
+ if (CHECKBIT(fields, DLOGF_ANGLE))
+  build_raw16(d->corr.curr_angle);
+ if (CHECKBIT(fields, DLOGF_KNOCK))
+ {
+  build_raw16(d->sens.knock_k);
+  build_raw16(d->corr.knock_retard);
+ }
+ if (CHECKBIT(fields, DLOGF_TPS))
+ {
+  build_raw8(d->sens.tps);
+#if defined(FUEL_INJECT) || defined(GD_CONTROL)
+  build_raw16(d->sens.tpsdot);
+#else
+  build_raw16(0);
+#endif
+ }
+ if (CHECKBIT(fields, DLOGF_ADDI))
+ {
+  build_raw16(d->sens.add_i1);
+  build_raw16(d->sens.add_i2);
+ }
+ if (CHECKBIT(fields, DLOGF_FLAGS))
+  build_raw8(get_sensor_flags(d));
+ if (CHECKBIT(fields, DLOGF_AALT))
+ {
+  build_raw16(d->corr.strt_aalt);
+  build_raw16(d->corr.idle_aalt);
+  build_raw16(d->corr.work_aalt);
+  build_raw16(d->corr.temp_aalt);
+  build_raw16(d->corr.airt_aalt);
+  build_raw16(d->corr.idlreg_aac);
+  build_raw16(d->corr.octan_aac
+#ifdef PA4_INP_IGNTIM
+  + d->corr.pa4_aac
+#endif
+  );
+ }
+ if (CHECKBIT(fields, DLOGF_LAMBDA))
+ {
+#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
+  build_raw16(d->corr.lambda);
+#else
+  build_raw16(0);
+#endif
+ }
+ if (CHECKBIT(fields, DLOGF_INJ))
+ {
+#ifdef FUEL_INJECT
+  build_raw16(d->inj_pw);
+  build_raw16(d->corr.inj_timing);
+#else
+  build_raw16(0);
+  build_raw16(0);
+#endif
+ }
+ if (CHECKBIT(fields, DLOGF_AIRTEMP))
+ {
+#ifdef AIRTEMP_SENS
+  build_raw16(d->sens.air_temp);
+#else
+  build_raw16(0);
+#endif
+ }
+ if (CHECKBIT(fields, DLOGF_SPEED))
+ {
+#ifdef SPEED_SENSOR
+  build_raw16(d->sens.speed);
+#else
+  build_raw16(0);
+#endif
+ }
+ if (CHECKBIT(fields, DLOGF_RAW))
+ {
+  build_raw16(d->sens.map_raw);
+  build_raw16(d->sens.voltage_raw);
+  build_raw16(d->sens.temperat_raw);
+  build_raw16(d->sens.tps_raw);
+  build_raw16(d->sens.add_i1_raw);
+  build_raw16(d->sens.add_i2_raw);
+ }
+
+ t = raw_crc;
+ build_raw16(t);
+
+ uart_begin_send();
+}
+
+//Sizes of elements of fields in received packets of parameters (see rfield_t)
+#define RFS_I4      0                   //!< 4-bit value (1 HEX symbol), stored as uint8_t
+#define RFS_I8      1                   //!< 8-bit value
+#define RFS_I16     2                   //!< 16-bit value
+#define RFS_I32     3                   //!< 32-bit value
+#define RFS_PACKET  0x0F                //!< not a field, but beginning of the packet's description
+
+/**Value of offset for fields which are received but not stored (stubs) */
+#define RF_SKIP     0xFFFF
+
+/**Gets offset of member in structure */
+#define secu3_offsetof(type,member)   ((size_t)(&((type *)0)->member))
+
+/**Describes field of received packet of parameters (used by recept_params()) */
+typedef struct
+{
+ uint16_t offset;                       //!< offset of field in params_t, RF_SKIP or descriptor of packet (RFS_PACKET)
+ uint8_t  size;                         //!< bits 0-3: size of element (RFS_x), bits 4-7: number of elements - 1
+}rfield_t;
+
+/**Beginning of the description of packet */
+#define RF_PACKET(desc)         {(desc), RFS_PACKET}
+/**Field of params_t */
+#define RF(field, size)         {secu3_offsetof(params_t, field), (size)}
+/**Array field of params_t */
+#define RFA(field, size, num)   {secu3_offsetof(params_t, field), (size) | (((num) - 1) << 4)}
+/**Received, but not stored field */
+#define RF_STUB(size)           {RF_SKIP, (size)}
+
+/**Descriptions of packets containing only parameters, which are decoded by recept_params().
+ * Fields of each packet are listed in the order of their transferring. Packets which require
+ * checking of values or contain not only parameters are decoded in uart_recept_packet() */
+PGM_DECLARE(rfield_t rfields[]) = {
+ RF_PACKET(TEMPER_PAR),
+ RF(tmp_use, RFS_I4),
+ RF(vent_pwm, RFS_I4),
+ RF(cts_use_map, RFS_I4),
+ RF(vent_on, RFS_I16),
+ RF(vent_off, RFS_I16),
+ RF(vent_pwmfrq, RFS_I16),
+ RF_PACKET(CARBUR_PAR),
+ RF(ie_lot, RFS_I16),
+ RF(ie_hit, RFS_I16),
+ RF(carb_invers, RFS_I4),
+ RF(fe_on_threshold, RFS_I16),
+ RF(ie_lot_g, RFS_I16),
+ RF(ie_hit_g, RFS_I16),
+ RF(shutoff_delay, RFS_I8),
+ RF(tps_threshold, RFS_I8),
+ RF(fuelcut_map_thrd, RFS_I16),
+ RF(fuelcut_cts_thrd, RFS_I16),
+ RF(revlim_lot, RFS_I16),
+ RF(revlim_hit, RFS_I16),
+ RF_PACKET(IDLREG_PAR),
+ RF(idl_flags, RFS_I8),                  //idling flags
+ RF(ifac1, RFS_I16),
+ RF(ifac2, RFS_I16),
+ RF(MINEFR, RFS_I16),
+ RF(idling_rpm, RFS_I16),
+ RF(idlreg_min_angle, RFS_I16),
+ RF(idlreg_max_angle, RFS_I16),
+ RF(idlreg_turn_on_temp, RFS_I16),
+ RF_PACKET(ANGLES_PAR),
+ RF(max_angle, RFS_I16),
+ RF(min_angle, RFS_I16),
+ RF(angle_corr, RFS_I16),
+ RF(angle_dec_speed, RFS_I16),
+ RF(angle_inc_speed, RFS_I16),
+ RF(zero_adv_ang, RFS_I4),
+ RF_PACKET(STARTR_PAR),
+ RF(starter_off, RFS_I16),
+ RF(smap_abandon, RFS_I16),
+ RF(inj_cranktorun_time, RFS_I16),       //fuel injection
+ RF(inj_aftstr_strokes, RFS_I8),         //fuel injection
+ RF(inj_prime_cold, RFS_I16),            //fuel injection
+ RF(inj_prime_hot, RFS_I16),             //fuel injection
+ RF(inj_prime_delay, RFS_I8),            //fuel injection
+ RF_PACKET(ADCCOR_PAR),
+ RF(map_adc_factor, RFS_I16),
+ RF(map_adc_correction, RFS_I32),
+ RF(ubat_adc_factor, RFS_I16),
+ RF(ubat_adc_correction, RFS_I32),
+ RF(temp_adc_factor, RFS_I16),
+ RF(temp_adc_correction, RFS_I32),
+ RF(tps_adc_factor, RFS_I16),
+ RF(tps_adc_correction, RFS_I32),
+ RF(ai1_adc_factor, RFS_I16),
+ RF(ai1_adc_correction, RFS_I32),
+ RF(ai2_adc_factor, RFS_I16),
+ RF(ai2_adc_correction, RFS_I32),
+ RF_PACKET(CKPS_PAR),
+ RF(ckps_edge_type, RFS_I4),
+ RF(ref_s_edge_type, RFS_I4),
+ RF(ckps_cogs_btdc, RFS_I8),
+ RF(ckps_ignit_cogs, RFS_I8),
+ RF(ckps_engine_cyl, RFS_I8),
+ RF(merge_ign_outs, RFS_I4),
+ RF(ckps_cogs_num, RFS_I8),
+ RF(ckps_miss_num, RFS_I8),
+ RF(hall_flags, RFS_I8),
+ RF(hall_wnd_width, RFS_I16),
+ RF_PACKET(KNOCK_PAR),
+ RF(knock_use_knock_channel, RFS_I4),
+ RF(knock_bpf_frequency, RFS_I8),
+ RF(knock_k_wnd_begin_angle, RFS_I16),
+ RF(knock_k_wnd_end_angle, RFS_I16),
+ RF(knock_int_time_const, RFS_I8),
+ RF(knock_retard_step, RFS_I16),
+ RF(knock_advance_step, RFS_I16),
+ RF(knock_max_retard, RFS_I16),
+ RF(knock_threshold, RFS_I16),
+ RF(knock_recovery_delay, RFS_I8),
+#ifdef FUEL_INJECT
+ RF_PACKET(INJCTR_PAR),
+ RF(inj_flags, RFS_I8),
+ RF(inj_config, RFS_I8),
+ RF(inj_flow_rate, RFS_I16),
+ RF(inj_cyl_disp, RFS_I16),
+ RF(inj_sd_igl_const, RFS_I32),
+ RF_STUB(RFS_I8),                        //stub
+ RF(inj_timing, RFS_I16),
+ RF(inj_timing_crk, RFS_I16),
+#endif
+#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
+ RF_PACKET(LAMBDA_PAR),
+ RF(inj_lambda_str_per_stp, RFS_I8),
+ RF(inj_lambda_step_size_p, RFS_I8),
+ RF(inj_lambda_step_size_m, RFS_I8),
+ RF(inj_lambda_corr_limit_p, RFS_I16),
+ RF(inj_lambda_corr_limit_m, RFS_I16),
+ RF(inj_lambda_swt_point, RFS_I16),
+ RF(inj_lambda_temp_thrd, RFS_I16),
+ RF(inj_lambda_rpm_thrd, RFS_I16),
+ RF(inj_lambda_activ_delay, RFS_I8),
+ RF(inj_lambda_dead_band, RFS_I16),
+#endif
+#if defined(FUEL_INJECT) || defined(GD_CONTROL)
+ RF_PACKET(ACCEL_PAR),
+ RF(inj_ae_tpsdot_thrd, RFS_I8),
+ RF(inj_ae_coldacc_mult, RFS_I8),
+#endif
+ RF_PACKET(DLOG_PAR),
+ RF(dlog_fields, RFS_I16),
+ RF(dlog_period, RFS_I8),
+ RF_PACKET(MFLT_PAR),
+ RFA(meas_flt_cfg, RFS_I8, MEAS_AVR_NUMBER),
+ RFA(meas_flt_slew, RFS_I8, MEAS_AVR_NUMBER),
+};
+
+/**Decodes received packet of parameters using its description from the rfields table
+ * \param d pointer to ECU data structure
+ * \param descriptor descriptor of received packet
+ * \return 1 - packet has been decoded, 0 - packet is not described in the table
+ */
+static uint8_t recept_params(struct ecudata_t* d, uint8_t descriptor)
+{
+ uint8_t i = 0, found = 0;
+ for(; i < sizeof(rfields) / sizeof(rfield_t); ++i)
+ {
+  uint16_t offset = PGM_GET_WORD(&rfields[i].offset);
+  uint8_t size = PGM_GET_BYTE(&rfields[i].size), num;
+
+  if (RFS_PACKET == size)
+  {
+   if (found)
+    break;                              //end of the packet's description
+   found = (offset == descriptor);
+   continue;
+  }
+  if (!found)
+   continue;
+
+  for(num = (size >> 4) + 1; num; --num)
+  {
+   uint8_t* p = ((uint8_t*)&d->param) + offset;
+   switch(size & 0x0F)
+   {
+    case RFS_I4:
+     if (RF_SKIP != offset) *p = recept_i4h(); else recept_i4h();
+     ++offset;
+     break;
+    case RFS_I8:
+     if (RF_SKIP != offset) *p = recept_i8h(); else recept_i8h();
+     ++offset;
+     break;
+    case RFS_I16:
+     if (RF_SKIP != offset) *((uint16_t*)p) = recept_i16h(); else recept_i16h();
+     offset+=2;
+     break;
+    default: //RFS_I32
+     if (RF_SKIP != offset) *((uint32_t*)p) = recept_i32h(); else recept_i32h();
+     offset+=4;
+   }
+  }
+ }
+ return found;
+}
+
 //TODO: remove it from here. It must be in secu3.c, use callback. E.g. on_bl_starting()
 /** Initialization of used I/O ports (   ) */
 void ckps_init_ports(void);
@@ -931,6 +1451,9 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
  uint8_t temp;
  uint8_t descriptor;
 
+ //take the oldest frame from the receiver's queue
+ uart.recv_buf = uart.recv_queue[uart.recv_tail & (UART_RECV_QUEUE_SIZE - 1)];
+ uart.recv_size = uart.recv_qsize[uart.recv_tail & (UART_RECV_QUEUE_SIZE - 1)];
  uart.recv_index = 0;
 
  descriptor = uart.recv_buf[uart.recv_index++];
@@ -938,6 +1461,10 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
 // TODO:   uart_recv_size    .
 //        
 
+ //packets containing only parameters are decoded using table
+ if (recept_params(d, descriptor))
+  return descriptor;
+
  //       
  switch(descriptor)
  {
@@ -948,7 +1475,7 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
   case BOOTLOADER:
    //TODO: in the future use callback and move following code out
    // .         
-   while (uart_is_sender_busy()) { wdt_reset_timer(); }
+   while (!uart_is_sender_idle()) { wdt_reset_timer(); }
    //     "cli",     
    _DISABLE_INTERRUPT();
    ckps_init_ports();
@@ -956,50 +1483,6 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
    boot_loader_start();
    break;
 
-  case TEMPER_PAR:
-   d->param.tmp_use   = recept_i4h();
-   d->param.vent_pwm  = recept_i4h();
-   d->param.cts_use_map = recept_i4h();
-   d->param.vent_on   = recept_i16h();
-   d->param.vent_off  = recept_i16h();
-   d->param.vent_pwmfrq = recept_i16h();
-   break;
-
-  case CARBUR_PAR:
-   d->param.ie_lot  = recept_i16h();
-   d->param.ie_hit  = recept_i16h();
-   d->param.carb_invers= recept_i4h();
-   d->param.fe_on_threshold= recept_i16h();
-   d->param.ie_lot_g = recept_i16h();
-   d->param.ie_hit_g = recept_i16h();
-   d->param.shutoff_delay = recept_i8h();
-   d->param.tps_threshold = recept_i8h();
-   d->param.fuelcut_map_thrd = recept_i16h();
-   d->param.fuelcut_cts_thrd = recept_i16h();
-   d->param.revlim_lot = recept_i16h();
-   d->param.revlim_hit = recept_i16h();
-   break;
-
-  case IDLREG_PAR:
-   d->param.idl_flags = recept_i8h();   //idling flags
-   d->param.ifac1     = recept_i16h();
-   d->param.ifac2     = recept_i16h();
-   d->param.MINEFR    = recept_i16h();
-   d->param.idling_rpm = recept_i16h();
-   d->param.idlreg_min_angle = recept_i16h();
-   d->param.idlreg_max_angle = recept_i16h();
-   d->param.idlreg_turn_on_temp = recept_i16h();
-   break;
-
-  case ANGLES_PAR:
-   d->param.max_angle = recept_i16h();
-   d->param.min_angle = recept_i16h();
-   d->param.angle_corr= recept_i16h();
-   d->param.angle_dec_speed = recept_i16h();
-   d->param.angle_inc_speed = recept_i16h();
-   d->param.zero_adv_ang = recept_i4h();
-   break;
-
   case FUNSET_PAR:
    temp = recept_i8h();
    if (temp < TABLES_NUMBER)
@@ -1021,63 +1504,10 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
     d->param.load_src_cfg = temp;
    break;
 
-  case STARTR_PAR:
-   d->param.starter_off = recept_i16h();
-   d->param.smap_abandon= recept_i16h();
-   d->param.inj_cranktorun_time = recept_i16h(); //fuel injection
-   d->param.inj_aftstr_strokes = recept_i8h();   //fuel injection
-   d->param.inj_prime_cold = recept_i16h();      //fuel injection
-   d->param.inj_prime_hot = recept_i16h();       //fuel injection
-   d->param.inj_prime_delay = recept_i8h();      //fuel injection
-   break;
-
-  case ADCCOR_PAR:
-   d->param.map_adc_factor     = recept_i16h();
-   d->param.map_adc_correction = recept_i32h();
-   d->param.ubat_adc_factor    = recept_i16h();
-   d->param.ubat_adc_correction= recept_i32h();
-   d->param.temp_adc_factor    = recept_i16h();
-   d->param.temp_adc_correction= recept_i32h();
-   //todo: In the future if we will have a lack of RAM we can split this packet into 2 pieces and decrease size of buffers
-   d->param.tps_adc_factor     = recept_i16h();
-   d->param.tps_adc_correction = recept_i32h();
-   d->param.ai1_adc_factor     = recept_i16h();
-   d->param.ai1_adc_correction = recept_i32h();
-   d->param.ai2_adc_factor     = recept_i16h();
-   d->param.ai2_adc_correction = recept_i32h();
-   break;
-
-  case CKPS_PAR:
-   d->param.ckps_edge_type = recept_i4h();
-   d->param.ref_s_edge_type = recept_i4h();
-   d->param.ckps_cogs_btdc  = recept_i8h();
-   d->param.ckps_ignit_cogs = recept_i8h();
-   d->param.ckps_engine_cyl = recept_i8h();
-   d->param.merge_ign_outs = recept_i4h();
-   d->param.ckps_cogs_num = recept_i8h();
-   d->param.ckps_miss_num = recept_i8h();
-   d->param.hall_flags = recept_i8h();
-   d->param.hall_wnd_width = recept_i16h();
-   break;
-
   case OP_COMP_NC:
    d->op_actn_code = recept_i16h();
    break;
 
-  case KNOCK_PAR:
-   d->param.knock_use_knock_channel = recept_i4h();
-   d->param.knock_bpf_frequency   = recept_i8h();
-   d->param.knock_k_wnd_begin_angle = recept_i16h();
-   d->param.knock_k_wnd_end_angle = recept_i16h();
-   d->param.knock_int_time_const = recept_i8h();
-
-   d->param.knock_retard_step = recept_i16h();
-   d->param.knock_advance_step = recept_i16h();
-   d->param.knock_max_retard = recept_i16h();
-   d->param.knock_threshold = recept_i16h();
-   d->param.knock_recovery_delay = recept_i8h();
-   break;
-
   case CE_SAVED_ERR:
    d->ecuerrors_saved_transfer = recept_i16h();
    break;
@@ -1157,41 +1587,6 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
    break;
   }
 
-#ifdef FUEL_INJECT
- case INJCTR_PAR:
-  d->param.inj_flags = recept_i8h();
-  d->param.inj_config = recept_i8h();
-  d->param.inj_flow_rate = recept_i16h();
-  d->param.inj_cyl_disp = recept_i16h();
-  d->param.inj_sd_igl_const = recept_i32h();
-  recept_i8h();      //stub
-  d->param.inj_timing = recept_i16h();
-  d->param.inj_timing_crk = recept_i16h();
-  break;
-#endif
-
-#if defined(FUEL_INJECT) || defined(CARB_AFR) || defined(GD_CONTROL)
- case LAMBDA_PAR:
-  d->param.inj_lambda_str_per_stp = recept_i8h();
-  d->param.inj_lambda_step_size_p = recept_i8h();
-  d->param.inj_lambda_step_size_m = recept_i8h();
-  d->param.inj_lambda_corr_limit_p = recept_i16h();
-  d->param.inj_lambda_corr_limit_m = recept_i16h();
-  d->param.inj_lambda_swt_point = recept_i16h();
-  d->param.inj_lambda_temp_thrd = recept_i16h();
-  d->param.inj_lambda_rpm_thrd = recept_i16h();
-  d->param.inj_lambda_activ_delay = recept_i8h();
-  d->param.inj_lambda_dead_band = recept_i16h();
-  break;
-#endif
-
-#if defined(FUEL_INJECT) || defined(GD_CONTROL)
- case ACCEL_PAR:
-  d->param.inj_ae_tpsdot_thrd = recept_i8h();
-  d->param.inj_ae_coldacc_mult = recept_i8h();
-  break;
-#endif
-
 #ifdef REALTIME_TABLES
   case EDITAB_PAR:
   {
@@ -1250,6 +1645,42 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
    }
   }
   break;
+
+  case TABBLK_PAR:
+  {
+   uint8_t op = recept_i8h();
+   uint8_t block = recept_i8h();
+   if (TBOP_READ == op)
+   {
+    uint8_t num = recept_i8h();
+    if (block < TABBLK_NUM && num)
+    {
+     tabblk.block = block;
+     tabblk.end = (num > TABBLK_NUM - block) ? TABBLK_NUM : block + num;
+     tabblk.op = TBOP_DATA;
+    }
+   }
+   else if (TBOP_WRITE == op)
+   {
+    uint8_t buff[TABBLK_SIZE];
+    uint8_t size = tabblk_size(block);
+    tabblk.status = TBST_BLOCK;
+    if (size)
+    {
+     recept_rb(buff, size);
+     if (crc16(buff, size) == recept_i16h())
+     { //block is applied only if it was received without errors
+      memcpy(((uint8_t*)&d->tables_ram) + (block * TABBLK_SIZE), buff, size);
+      tabblk.status = TBST_OK;
+     }
+     else
+      tabblk.status = TBST_CRC;
+    }
+    tabblk.block = block;
+    tabblk.op = TBOP_ACK;
+   }
+  }
+  break;
 #endif
 #ifdef DIAGNOSTICS
   case DIAGOUT_DAT:
@@ -1264,17 +1695,22 @@ uint8_t uart_recept_packet(struct ecudata_t* d)
 
 void uart_notify_processed(void)
 {
- uart.recv_size = 0;
+ ++uart.recv_tail;                      //frame is removed from the queue
+}
+
+uint8_t uart_is_sender_idle(void)
+{
+ return (uart.send_tail == uart.send_end);
 }
 
 uint8_t uart_is_sender_busy(void)
 {
- return (uart.send_size > 0);
+ return ((uint8_t)(uart.send_head - uart.send_tail) > (UART_SEND_BUFF_SIZE - UART_SEND_PACKET_MAX - 1));
 }
 
 uint8_t uart_is_packet_received(void)
 {
- return (uart.recv_size > 0);
+ return (uart.recv_head != uart.recv_tail);
 }
 
 uint8_t uart_get_send_mode(void)
@@ -1326,20 +1762,32 @@ uint8_t uart_set_send_mode(uint8_t descriptor)
 #ifdef DEBUG_VARIABLES
   case DBGVAR_DAT:
 #endif
+#ifdef ISR_PROFILING
+  case ISRPRF_DAT:
+#endif
+#ifdef LOOP_PROFILING
+  case LOOPPRF_DAT:
+#endif
 #ifdef DIAGNOSTICS
   case DIAGINP_DAT:
 #endif
+  case DATLOG_DAT:
+  case DLOG_PAR:
+  case MFLT_PAR:
+   return uart.send_mode = descriptor;
+  case SENDLT_DAT:
+   sdelta.cnt = 0;                      //first packet will be keyframe
    return uart.send_mode = descriptor;
   default:
    return uart.send_mode; //dot not set not existing context
  }
 }
 
-/** Clears sender's buffer
+/** Discards data appended to sender's buffer since last call of uart_begin_send()
  */
 void uart_reset_send_buff(void)
 {
- uart.send_size = 0;
+ uart.send_head = uart.send_end;
 }
 
 /** Append sender's buffer by one byte. This function is used in the bluetooth module
@@ -1347,13 +1795,14 @@ void uart_reset_send_buff(void)
  */
 void uart_append_send_buff(uint8_t ch)
 {
- uart.send_buf[uart.send_size++] = ch;
+ uart.send_buf[uart.send_head++] = ch;
 }
 
 /**Used to convert baud rate ID to baud rate value*/
 PGM_DECLARE(uint16_t brtoid[CBRID_NUM][2]) = {
       {CBR_2400, CBRID_2400},   {CBR_4800, CBRID_4800},   {CBR_9600, CBRID_9600},   {CBR_14400, CBRID_14400},
-      {CBR_19200, CBRID_19200}, {CBR_28800, CBRID_28800}, {CBR_38400, CBRID_38400}, {CBR_57600, CBRID_57600}};
+      {CBR_19200, CBRID_19200}, {CBR_28800, CBRID_28800}, {CBR_38400, CBRID_38400}, {CBR_57600, CBRID_57600},
+      {CBR_115200, CBRID_115200}};
 
 uint16_t convert_id_to_br(uint16_t id)
 {
@@ -1364,6 +1813,13 @@ uint16_t convert_id_to_br(uint16_t id)
  return CBR_9600;
 }
 
+#ifdef REALTIME_TABLES
+uint8_t uart_get_tabblk_op(void)
+{
+ return tabblk.op;
+}
+#endif
+
 void uart_init(uint16_t baud)
 {
  baud = convert_id_to_br(baud);
@@ -1379,8 +1835,8 @@ void uart_init(uint16_t baud)
  UCSRC=/*_BV(USBS)|*/_BV(UCSZ1)|_BV(UCSZ0);                  //8 , 1 ,   
 #endif
 
- uart.send_size = 0;                                         //    
- uart.recv_size = 0;                                         //  
+ uart.send_head = uart.send_end = uart.send_tail = 0;        //    
+ uart.recv_head = uart.recv_tail = 0;                       //  
  uart.send_mode = SENSOR_DAT;
 }
 
@@ -1390,11 +1846,9 @@ void uart_init(uint16_t baud)
  */
 ISR(USART_UDRE_vect)
 {
- if (uart.send_size > 0)
+ if (uart.send_tail != uart.send_end)
  {
-  UDR = uart.send_buf[uart.send_index];
-  --uart.send_size;
-  ++uart.send_index;
+  UDR = uart.send_buf[uart.send_tail++];
  }
  else
  {//  
@@ -1406,19 +1860,21 @@ ISR(USART_UDRE_vect)
 ISR(USART_RXC_vect)
 {
  static uint8_t state=0;
+ static uint8_t index;  //index in frame being received
  uint8_t chr = UDR;
+ ISRPROF_BEGIN();
 
  _ENABLE_INTERRUPT();
  switch(state)
  {
   case 0:            // (   )
-   if (uart.recv_size!=0) //     ,     .
+   if ((uint8_t)(uart.recv_head - uart.recv_tail) >= UART_RECV_QUEUE_SIZE) //queue is full, all received frames are not processed yet
     break;
 
    if (chr=='!')   // ?
    {
     state = 1;
-    uart.recv_index = 0;
+    index = 0;
    }
    break;
 
@@ -1426,18 +1882,20 @@ ISR(USART_RXC_vect)
    if (chr=='\r')
    {
     state = 0;       //   
-    uart.recv_size = uart.recv_index; // ,   
+    uart.recv_qsize[uart.recv_head & (UART_RECV_QUEUE_SIZE - 1)] = index; // ,   
+    ++uart.recv_head; //frame is put into the queue
    }
    else
    {
-    if (uart.recv_index >= UART_RECV_BUFF_SIZE)
+    if (index >= UART_RECV_BUFF_SIZE)
     {
      //: ! -    ,    !
      state = 0;
     }
     else
-     uart.recv_buf[uart.recv_index++] = chr;
+     uart.recv_queue[uart.recv_head & (UART_RECV_QUEUE_SIZE - 1)][index++] = chr;
    }
    break;
  }
+ ISRPROF_END(ISRPROF_UARTRX);
 }
@@ -41,6 +41,7 @@
 //       28800       0x2A          0x56
 //       38400       0x20          0x40
 //       57600       0x15          0x2A
+//       115200      0x0A          0x15
 
 #define  CBR_2400                0x0411 //!<  2400 baud
 #define  CBR_4800                0x0208 //!<  4800 baud
@@ -50,6 +51,7 @@
 #define  CBR_28800               0x0056 //!< 28800 baud
 #define  CBR_38400               0x0040 //!< 38400 baud
 #define  CBR_57600               0x002A //!< 57600 baud
+#define  CBR_115200              0x0015 //!< 115200 baud
 
 
 //Define ID for each baud rate value
@@ -61,18 +63,24 @@
 #define  CBRID_28800             0x0044 //!< 28800 baud ID
 #define  CBRID_38400             0x0033 //!< 38400 baud ID
 #define  CBRID_57600             0x0022 //!< 57600 baud ID
-#define  CBRID_NUM               8      //!< Number of IDs
+#define  CBRID_115200            0x0010 //!< 115200 baud ID
+#define  CBRID_NUM               9      //!< Number of IDs
 
 
-#define  UART_RECV_BUFF_SIZE     82     //!< Size of receiver's buffer
-#define  UART_SEND_BUFF_SIZE     112    //!< Size of transmitter's buffer
+#define  UART_RECV_BUFF_SIZE     82     //!< Size of receiver's buffer (maximum size of one frame)
+#define  UART_RECV_QUEUE_SIZE    2      //!< Number of frames in the receiver's queue (must be power of 2)
+#define  UART_SEND_BUFF_SIZE     256    //!< Size of transmitter's ring buffer (must be 256, indexes wrap around naturally)
+/**Maximum size of one packet being send (including escape bytes). The largest one is SENDLT_DAT with all fields changed:
+ * '@', descriptor, mask (8), 52 bytes of fields (104) and '\r' = 115 bytes */
+#define  UART_SEND_PACKET_MAX    120
 
 // Interface of the module ( )
 
  struct ecudata_t;
 
 /**Builds a packet depending of type of the current descriptor and launches it on the transfer.
- * Function does not check the transmitter is busy or not, it should be done before the call
+ * Packet is appended to the transmitter's ring buffer, so it can be built while previous packets are
+ * being sent. Function does not check the transmitter is busy or not, it should be done before the call
  * (C           .  
  *     ,       ).
  * \param d pointer to ECU data structure
@@ -80,6 +88,15 @@
  */
  void uart_send_packet(struct ecudata_t* d, uint8_t send_mode);
 
+/**Builds binary datalog frame and launches it on the transfer. Frame has fixed layout and is not escaped:
+ * sync byte (0xA5), length, sequence number, time stamp (2 bytes), mask of fields (2 bytes), fields, CRC16 (2 bytes).
+ * Length is number of bytes from sequence number to the last field. CRC is calculated from length to the last field.
+ * Set of fields is selected by dlog_fields parameter (see DLOGF_x constants, DLOG_PAR packet). Function does not check the transmitter
+ * is busy or not, it should be done before the call.
+ * \param d pointer to ECU data structure
+ */
+ void uart_send_dlog_frame(struct ecudata_t* d);
+
 /**This function does not check was or wasn't frame received, checking must be done before the
  * call (   ,      ,    
  *   ).
@@ -88,14 +105,17 @@
  */
  uint8_t uart_recept_packet(struct ecudata_t* d);
 
-/**Call this function to tell service that you already accepted frame (reset busy state) */
+/**Call this function to tell service that you already accepted frame (frame is removed from the receiver's queue) */
  void uart_notify_processed(void);
 
-/**\return 1 if sender is busy, otherwise - 0 */
+/**\return 1 if sender is busy (there is no room for a next packet in the transmitter's ring buffer), otherwise - 0 */
  uint8_t uart_is_sender_busy(void);
 
+/**\return 1 if all data from the transmitter's ring buffer has been sent, otherwise - 0 */
+ uint8_t uart_is_sender_idle(void);
+
 /**This function checks for received frame
- * \return 1 if unprocessed frame is pending
+ * \return 1 if unprocessed frame is pending in the receiver's queue
  */
  uint8_t uart_is_packet_received(void);
 
@@ -119,4 +139,27 @@
  */
  uint16_t convert_id_to_br(uint16_t id);
 
+#ifdef REALTIME_TABLES
+//Bulk transfer of set of tables in RAM (TABBLK_PAR packets). Tables are transferred by blocks of
+//TABBLK_SIZE bytes, each block has CRC16 of its data. Formats of packets (all values are 8-bit,
+//except CRC which is 16-bit):
+// PC  -> ECU: TBOP_READ,  first block, number of blocks  - ECU will send all requested blocks back-to-back
+// PC  -> ECU: TBOP_WRITE, block, data, CRC               - ECU will reply with acknowledgement
+// ECU -> PC : TBOP_DATA,  block, data, CRC
+// ECU -> PC : TBOP_ACK,   block, status (TBST_x)
+#define  TABBLK_SIZE             32     //!< Size of block in bytes (the last block of set can be shorter)
+#define  TBOP_READ               1      //!< request for reading of blocks
+#define  TBOP_WRITE              2      //!< block to be written
+#define  TBOP_DATA               3      //!< block which has been read
+#define  TBOP_ACK                4      //!< acknowledgement of written block
+#define  TBST_OK                 0      //!< block has been written
+#define  TBST_CRC                1      //!< block has not been written because of wrong CRC
+#define  TBST_BLOCK              2      //!< block has not been written because of wrong number of block
+
+/** \return code of pending operation of bulk transfer of tables (TBOP_DATA or TBOP_ACK), 0 - nothing to send.
+ * When operation is pending, packet TABBLK_PAR must be sent as soon as transmitter is not busy
+ */
+ uint8_t uart_get_tabblk_op(void);
+#endif
+
 #endif //_UART_H_
@@ -58,6 +58,8 @@
 #define   ATTTAB_PAR   '}'   //!< used for transferring of attenuator map (knock detection related)
 #define   RPMGRD_PAR   '"'   //!< used for transferring of RPM grid
 #define   DBGVAR_DAT   ':'   //!< for watching of firmware variables (used for debug purposes)
+#define   ISRPRF_DAT   '$'   //!< statistics of execution time of interrupts (used for debug purposes)
+#define   LOOPPRF_DAT  '('   //!< statistics of execution time of the main loop (used for debug purposes)
 #define   DIAGINP_DAT  '='   //!< diagnostics: send input values (analog & digital values)
 #define   DIAGOUT_DAT  '^'   //!< diagnostics: receive output states (bits)
 
@@ -72,4 +74,10 @@
 #define   GASDOSE_PAR  '*'   //!< gas dose parameters
 #define   SIGINF_DAT   '~'   //! signature information
 
+#define   SENDLT_DAT   '<'   //!< delta-compressed sensors' data: mask of changed fields (32 bits) and changed fields of SENSOR_DAT packet
+#define   TABBLK_PAR   '+'   //!< bulk transfer of set of tables in RAM by blocks with CRC (see TBOP_x codes in uart.h)
+#define   DATLOG_DAT   '>'   //!< high-rate datalog mode: compact binary frames with CRC (not escaped, see uart_send_dlog_frame())
+#define   DLOG_PAR     ']'   //!< parameters of high-rate datalog mode: set of fields and period of frames
+#define   MFLT_PAR     '['   //!< configuration of filters and slew-rate limits of measured values
+
 #endif //_UFCODES_H_
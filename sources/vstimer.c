@@ -30,9 +30,11 @@
 #include "port/intrinsic.h"
 #include "port/pgmspace.h"
 #include "port/port.h"
+#include "adc.h"
 #include "bitmask.h"
 #include "ce_errors.h"
 #include "ioconfig.h" //for SM_CONTROL
+#include "profiler.h"
 #include "tables.h"
 #include "vstimer.h"
 
@@ -40,19 +42,23 @@
  frequency will be divided by 6 */
 #define DIVIDER_RELOAD       5
 
-//TODO: Do refactoring of timers! Implement callback mechanism.
+/**Initial state of timer object: expired, not in the list, no callback */
+#define S_TIMER_EXPIRED {0, 0, 0, 1}
 
-volatile s_timer8_t  send_packet_interval_counter = 0;    //!< used for sending of packets
-volatile s_timer8_t  force_measure_timeout_counter = 0;   //!< used by measuring process when engine is stopped
-volatile s_timer8_t  ce_control_time_counter = CE_CONTROL_STATE_TIME_VALUE; //!< used for counting of time intervals for CE
-volatile s_timer8_t  engine_rotation_timeout_counter = 0; //!< used to determine that engine was stopped
-volatile s_timer8_t  epxx_delay_time_counter = 0;         //!< used by idle economizer's controlling algorithm
-volatile s_timer8_t  idle_period_time_counter = 0;        //!< used by idling regulator's controlling algorithm
-volatile s_timer16_t save_param_timeout_counter = 0;      //!< used for saving of parameters (automatic saving)
+s_timer_t send_packet_interval_counter = S_TIMER_EXPIRED;    //!< used for sending of packets
+s_timer_t force_measure_timeout_counter = S_TIMER_EXPIRED;   //!< used by measuring process when engine is stopped
+s_timer_t ce_control_time_counter = S_TIMER_EXPIRED;         //!< used for counting of time intervals for CE
+s_timer_t engine_rotation_timeout_counter = S_TIMER_EXPIRED; //!< used to determine that engine was stopped
+s_timer_t epxx_delay_time_counter = S_TIMER_EXPIRED;         //!< used by idle economizer's controlling algorithm
+s_timer_t idle_period_time_counter = S_TIMER_EXPIRED;        //!< used by idling regulator's controlling algorithm
+s_timer_t save_param_timeout_counter = S_TIMER_EXPIRED;      //!< used for saving of parameters (automatic saving)
 #ifdef FUEL_PUMP
-volatile s_timer16_t fuel_pump_time_counter = 0;          //!< used for fuel pump
+s_timer_t fuel_pump_time_counter = S_TIMER_EXPIRED;          //!< used for fuel pump
 #endif
-volatile s_timer16_t powerdown_timeout_counter = 0;       //!< used for power-down timeout 
+s_timer_t powerdown_timeout_counter = S_TIMER_EXPIRED;       //!< used for power-down timeout
+
+/**Head of the list of armed timers, sorted by deadlines (the nearest one is first) */
+static s_timer_t* s_timer_list = 0;
 
 /**for division, to achieve 10ms, because timer overflovs each 2 ms */
 uint8_t divider = DIVIDER_RELOAD;
@@ -91,6 +97,7 @@ extern uint8_t cafr_soft_cnt;
  */
 ISR(TIMER2_OVF_vect)
 {
+ ISRPROF_BEGIN();
  _ENABLE_INTERRUPT();
 
 #ifdef SM_CONTROL
@@ -150,24 +157,16 @@ ISR(TIMER2_OVF_vect)
   IOCFG_SET(IOP_FE, 0); //OFF
 #endif
 
+ adc_begin_measure_fast(); //sample fast channels (MAP, TPS) at high rate
+
  if (divider > 0)
   --divider;
  else
  {//each 10 ms
   divider = DIVIDER_RELOAD;
-  s_timer_update(force_measure_timeout_counter);
-  s_timer_update(save_param_timeout_counter);
-  s_timer_update(send_packet_interval_counter);
-  s_timer_update(ce_control_time_counter);
-  s_timer_update(engine_rotation_timeout_counter);
-  s_timer_update(epxx_delay_time_counter);
-  s_timer_update(idle_period_time_counter);
-#ifdef FUEL_PUMP
-  s_timer_update(fuel_pump_time_counter);
-#endif
-  s_timer_update(powerdown_timeout_counter);
-  ++sys_counter;
+  ++sys_counter;        //timers' deadlines are checked in s_timer_dispatch()
  }
+ ISRPROF_END(ISRPROF_SYSTMR);
 }
 
 void s_timer_init(void)
@@ -175,4 +174,51 @@ void s_timer_init(void)
  TCCR2B|= _BV(CS22)|_BV(CS20); //clock = 156.25kHz (tick = 6.4us)
  TCNT2 = 0;
  TIMSK2|= _BV(TOIE2);
+
+ s_timer_set(ce_control_time_counter, CE_CONTROL_STATE_TIME_VALUE);
+}
+
+void s_timer_start(s_timer_t* p_timer, uint16_t value)
+{
+ s_timer_t** pp;
+
+ //remove timer from the list if it is armed
+ if (!p_timer->expired)
+ {
+  for(pp = &s_timer_list; *pp; pp = &(*pp)->next)
+   if (*pp == p_timer)
+   {
+    *pp = p_timer->next;
+    break;
+   }
+ }
+
+ if (0==value)
+ {
+  p_timer->expired = 1;
+  return;
+ }
+
+ p_timer->deadline = s_timer_gtc() + value;
+ p_timer->expired = 0;
+
+ //insert timer into the list keeping it sorted (after timers with the same deadline)
+ for(pp = &s_timer_list; *pp && ((int16_t)((*pp)->deadline - p_timer->deadline)) <= 0; pp = &(*pp)->next);
+ p_timer->next = *pp;
+ *pp = p_timer;
+}
+
+void s_timer_dispatch(void)
+{
+ uint16_t now = s_timer_gtc();
+
+ //only head of the list must be checked, because list is sorted
+ while(s_timer_list && ((int16_t)(now - s_timer_list->deadline)) >= 0)
+ {
+  s_timer_t* p_timer = s_timer_list;
+  s_timer_list = p_timer->next;
+  p_timer->expired = 1;
+  if (p_timer->callback)
+   p_timer->callback(); //callback may arm timer again
+ }
 }
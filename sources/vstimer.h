@@ -32,45 +32,39 @@
 #include "port/intrinsic.h"
 #include <stdint.h>
 
-//    
+/**Type of callback function which is called from s_timer_dispatch() when timer expires */
+typedef void (*s_timer_cb_t)(void);
 
-//  . 8-     
-// 2.56 . 16-       655 .
-typedef uint8_t   s_timer8_t;  //!< used by 8-bit timers
-typedef uint16_t  s_timer16_t; //!< used by 16-bit timers
-
-/**Update state of specified timer (   ) */
-#define s_timer_update(T)    { if ((T) > 0) (T)--; }
+/**Object of virtual timer. Armed timers are kept in the list sorted by their deadlines,
+ * so the interrupt only increments system tick counter and all work is done in the main loop.
+ * Timer can count periods up to 327 sec. */
+typedef struct s_timer_t
+{
+ uint16_t deadline;            //!< value of system tick counter at which timer will expire
+ struct s_timer_t* next;       //!< next armed timer in the list (with later deadline)
+ s_timer_cb_t callback;        //!< called from main loop when timer expires, can be 0
+ uint8_t expired;              //!< 1 - timer is expired (not in the list), 0 - timer is armed
+}s_timer_t;
 
 /**Initialization of state of specified timer. One tick = 10ms
  *(   .     10 ). */
-#define s_timer_set(T, V)    { (T) = (V); }
+#define s_timer_set(T, V)    s_timer_start(&(T), (V))
 
 /**Checks whenever specified timer is completed (    ) */
-#define s_timer_is_action(T) ((T)==0)
-
-//,    16-   .
-//         , 
-//  .
-
-/**Set specified timer for specified period */
-#define s_timer16_set(T, V)  \
-{                            \
- _BEGIN_ATOMIC_BLOCK();      \
- (T) = (V);                  \
- _END_ATOMIC_BLOCK();        \
-}
+#define s_timer_is_action(T) ((T).expired)
 
-/**Check specified timer for action */
-static INLINE
-uint8_t s_timer16_is_action(s_timer16_t i_timer)
-{
- uint8_t result;
- _BEGIN_ATOMIC_BLOCK();
- result = (i_timer == 0);
- _END_ATOMIC_BLOCK();
- return result;
-}
+/**Set callback function for specified timer. It will be called each time timer expires */
+#define s_timer_set_cb(T, CB) { (T).callback = (CB); }
+
+/**Arm specified timer (timer is removed from list and inserted again if it is already armed)
+ * \param p_timer pointer to timer object
+ * \param value period in system ticks (1...32767), 0 - expire timer immediately (callback is not called)
+ */
+void s_timer_start(s_timer_t* p_timer, uint16_t value);
+
+/**Checks deadlines of armed timers, marks expired ones and calls their callbacks.
+ * Must be called from the main loop, because timers are not accessed from interrupts */
+void s_timer_dispatch(void);
 
 extern volatile uint16_t sys_counter;
 /**Get value of the system 10ms counter */
@@ -88,17 +82,17 @@ uint16_t s_timer_gtc(void)
 void s_timer_init(void);
 
 //////////////////////////////////////////////////////////////////
-extern volatile s_timer8_t  send_packet_interval_counter;
-extern volatile s_timer8_t  force_measure_timeout_counter;
-extern volatile s_timer8_t  ce_control_time_counter;
-extern volatile s_timer8_t  engine_rotation_timeout_counter;
-extern volatile s_timer8_t  epxx_delay_time_counter;
-extern volatile s_timer8_t  idle_period_time_counter;
-extern volatile s_timer16_t save_param_timeout_counter;
+extern s_timer_t send_packet_interval_counter;
+extern s_timer_t force_measure_timeout_counter;
+extern s_timer_t ce_control_time_counter;
+extern s_timer_t engine_rotation_timeout_counter;
+extern s_timer_t epxx_delay_time_counter;
+extern s_timer_t idle_period_time_counter;
+extern s_timer_t save_param_timeout_counter;
 #ifdef FUEL_PUMP
-extern volatile s_timer16_t fuel_pump_time_counter;
+extern s_timer_t fuel_pump_time_counter;
 #endif
-extern volatile s_timer16_t powerdown_timeout_counter;
+extern s_timer_t powerdown_timeout_counter;
 //////////////////////////////////////////////////////////////////
 
 #endif //_VSTIMER_H_